@@ -0,0 +1,191 @@
+#!/bin/sh
+# bench.sh - benchmark matrix over the MP1 echo servers (run by `make bench`)
+#
+# For every variant and workload the server is started on a free loopback port
+# in a session of its own and driven by optimized_chatGPT/echo_bench --csv.
+# While the load runs, the memory of all the server's processes (forked children
+# and prefork workers included) is sampled; their CPU time is read at the end.
+# Results go to $OUT.csv and $OUT.json, with a summary table on stdout.
+#
+# Environment: VARIANTS, WORKLOADS, DURATION (seconds per run), OUT,
+# SERVER_FLAGS (extra options for the optimized server).
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+BENCH=$DIR/optimized_chatGPT/echo_bench
+VARIANTS=${VARIANTS:-"original chatgpt optimized-fork optimized-epoll optimized-prefork optimized-reactor optimized-uring optimized-coro"}
+WORKLOADS=${WORKLOADS:-"storm idle pipelined large"}
+DURATION=${DURATION:-5}
+OUT=${OUT:-$DIR/bench_results}
+HZ=$(getconf CLK_TCK)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+ulimit -n "$(ulimit -Hn)" 2>/dev/null  # idle and storm runs hold thousands of sockets
+
+server_cmd() {  # variant port
+    case $1 in
+    original) echo "$DIR/original_work/server $2" ;;
+    chatgpt) echo "$DIR/chatgpt/server $2" ;;
+    optimized-*) echo "$DIR/optimized_chatGPT/server --mode=${1#optimized-} $SERVER_FLAGS $2" ;;
+    *) return 1 ;;
+    esac
+}
+
+workload_args() {
+    case $1 in
+    storm) echo "--conns=1000 --size=64 --pipeline=1" ;;     # every connect at once
+    idle) echo "--conns=2000 --size=64 --rate=1" ;;          # many connections, one line a second each
+    pipelined) echo "--conns=50 --size=64 --pipeline=16" ;;  # small lines, 16 in flight per connection
+    large) echo "--conns=8 --size=65536 --pipeline=1" ;;     # 64 KB payloads
+    *) return 1 ;;
+    esac
+}
+
+# a port below the usual ephemeral range, so it never collides with client ports
+pick_port() {
+    while :; do
+        port=$(awk -v seed="$$$(date +%N)" 'BEGIN { srand(seed); print 20000 + int(rand() * 12000) }')
+        [ -z "$(ss -Htln "sport = :$port" 2>/dev/null)" ] && return
+    done
+}
+
+listening() {
+    [ -n "$(ss -Htln "sport = :$1" 2>/dev/null)" ]
+}
+
+# proportional set size of every process in the session, in KB: shared pages are
+# split between the processes mapping them, so forked children are not overcounted
+session_pss() {
+    pgrep -s "$1" | sed 's|.*|/proc/&/smaps_rollup|' | xargs cat 2>/dev/null |
+        awk '/^Pss:/ { kb += $2 } END { print kb + 0 }'
+}
+
+# user + system CPU seconds of every process in the session, reaped children included
+session_cpu() {
+    pgrep -s "$1" | sed 's|.*|/proc/&/stat|' | xargs cat 2>/dev/null |
+        awk -v hz="$HZ" '{ sub(/^.*\) /, ""); t += $12 + $13 + $14 + $15 } END { printf "%.2f", t / hz }'
+}
+
+# start server variant $1 on a free port; sets $port and $sid (its pid and session)
+start_server() {
+    for try in 1 2 3 4 5; do
+        pick_port
+        setsid $(server_cmd "$1" "$port") </dev/null >/dev/null 2>&1 &
+        sid=$!
+        for i in $(seq 50); do
+            listening "$port" && return 0
+            kill -0 "$sid" 2>/dev/null || break  # bind failed - try another port
+            sleep 0.1
+        done
+        stop_server
+    done
+    echo "bench: $1 did not start" >&2
+    return 1
+}
+
+stop_server() {
+    kill -TERM -"$sid" 2>/dev/null
+    for i in $(seq 20); do
+        pgrep -s "$sid" >/dev/null || break
+        sleep 0.1
+    done
+    kill -KILL -"$sid" 2>/dev/null
+    wait "$sid" 2>/dev/null
+}
+
+# one row: variant,workload,<echo_bench fields>,server_cpu_s,server_pss_kb,status
+run_one() {
+    variant=$1 workload=$2
+    if ! start_server "$variant"; then
+        echo "$variant,$workload,@EMPTY@,,,no-start" >>"$TMP/rows"
+        return
+    fi
+    cpu0=$(session_cpu "$sid")
+    peak=$(session_pss "$sid")
+    timeout -k 5 $((DURATION * 2 + 60)) "$BENCH" --csv --duration="$DURATION" \
+        $(workload_args "$workload") 127.0.0.1 "$port" >"$TMP/out" 2>"$TMP/err" &
+    bench=$!
+    while kill -0 "$bench" 2>/dev/null; do
+        sleep 0.5
+        kb=$(session_pss "$sid")
+        [ "$kb" -gt "$peak" ] && peak=$kb
+    done
+    wait "$bench"
+    rc=$?
+    sleep 0.5  # let forked children see the disconnects and exit
+    if kill -0 "$sid" 2>/dev/null; then
+        cpu=$(awk -v a="$cpu0" -v b="$(session_cpu "$sid")" 'BEGIN { printf "%.2f", b - a }')
+    else
+        cpu=  # its CPU time went with it
+    fi
+    stop_server
+
+    case $rc in
+    0) status=ok ;;
+    2) status=mismatch ;;
+    124 | 137) status=timeout ;;
+    *) status=failed ;;
+    esac
+    [ -z "$cpu" ] && status=server-exited
+    if [ "$(wc -l <"$TMP/out")" -eq 2 ]; then
+        head -n 1 "$TMP/out" >"$TMP/header"
+        echo "$variant,$workload,$(tail -n 1 "$TMP/out"),$cpu,$peak,$status" >>"$TMP/rows"
+    else
+        echo "$variant,$workload,@EMPTY@,$cpu,$peak,$status" >>"$TMP/rows"
+        sed "s/^/bench: $variant $workload: /" "$TMP/err" >&2
+    fi
+}
+
+# CSV to a JSON array of objects; numbers stay numbers, empty fields become null
+to_json() {
+    awk -F, '
+        NR == 1 { n = split($0, key, ","); print "["; next }
+        {
+            printf "%s  {", (NR > 2 ? ",\n" : "")
+            for (i = 1; i <= n; i++) {
+                v = $i
+                if (v == "") v = "null"
+                else if (v !~ /^-?[0-9]+(\.[0-9]+)?$/) v = "\"" v "\""
+                printf "%s\"%s\": %s", (i > 1 ? ", " : ""), key[i], v
+            }
+            printf "}"
+        }
+        END { print "\n]" }' "$1"
+}
+
+summary() {
+    awk -F, '
+        NR == 1 { for (i = 1; i <= NF; i++) col[$i] = i
+                  printf "%-18s %-10s %11s %10s %9s %9s %11s %8s %9s  %s\n", "variant", "workload",
+                         "connected", "msg/s", "p50 us", "p99 us", "conn p99", "cpu s", "pss KB", "status"
+                  next }
+        { printf "%-18s %-10s %11s %10s %9s %9s %11s %8s %9s  %s\n", $1, $2,
+                 $col["connected"] "/" $col["conns"], $col["msg_per_s"],
+                 $col["rtt_p50_us"], $col["rtt_p99_us"], $col["connect_p99_us"],
+                 $col["server_cpu_s"], $col["server_pss_kb"], $col["status"] }' "$1"
+}
+
+for v in $VARIANTS; do
+    server_cmd "$v" 0 >/dev/null || { echo "bench: unknown variant $v" >&2; exit 1; }
+done
+for w in $WORKLOADS; do
+    workload_args "$w" >/dev/null || { echo "bench: unknown workload $w" >&2; exit 1; }
+done
+
+for v in $VARIANTS; do
+    for w in $WORKLOADS; do
+        echo "bench: $v $w" >&2
+        run_one "$v" "$w"
+    done
+done
+
+if [ ! -s "$TMP/header" ]; then
+    echo "bench: no run produced results" >&2
+    exit 1
+fi
+header="variant,workload,$(cat "$TMP/header"),server_cpu_s,server_pss_kb,status"
+empty=$(cat "$TMP/header" | sed 's/[^,]//g')  # a failed run gets the echo_bench fields empty
+{ echo "$header"; sed "s/@EMPTY@/$empty/" "$TMP/rows"; } >"$OUT.csv"
+to_json "$OUT.csv" >"$OUT.json"
+summary "$OUT.csv"
+echo "bench: results in $OUT.csv and $OUT.json" >&2
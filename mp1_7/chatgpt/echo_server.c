@@ -6,7 +6,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 
-#define PORT 12346  // Port number for the server
+#define PORT 12346  // Default port number for the server
 
 void handle_client(int client_fd) {
     char buffer[1024];
@@ -27,8 +27,9 @@ void handle_client(int client_fd) {
     close(client_fd);
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     int server_fd, client_fd;
+    int port = argc > 1 ? atoi(argv[1]) : PORT;  // optional port argument
     struct sockaddr_in server_addr, client_addr;
     socklen_t client_len = sizeof(client_addr);
 
@@ -42,7 +43,7 @@ int main() {
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+    server_addr.sin_port = htons(port);
 
     // Bind the socket to the address
     if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
@@ -58,7 +59,7 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
-    printf("Server listening on port %d\n", PORT);
+    printf("Server listening on port %d\n", port);
 
     while (1) {
         // Accept an incoming connection
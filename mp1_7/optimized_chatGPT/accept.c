@@ -0,0 +1,157 @@
+#define _GNU_SOURCE  // accept4()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "accept.h"
+#include "stats.h"
+
+// one accepting thread per process, so the counters need no locking
+static int listen_fd = -1;
+static int spare_fd = -1;        // held in reserve; given up to shed a connection at EMFILE
+static uint64_t accepted;        // connections handed to the server
+static uint64_t wakeups;         // accept_drain() calls that found something
+static uint64_t max_batch;       // most connections taken in one drain
+static uint64_t fd_exhausted;    // EMFILE/ENFILE: connections dropped for lack of descriptors
+static unsigned long long base_overflows, base_drops;  // netstat at startup
+
+// TcpExt ListenOverflows and ListenDrops from /proc/net/netstat; these are host-wide
+// (every listener in the network namespace), so the dump shows them since startup
+static int read_listen_counters(unsigned long long *overflows, unsigned long long *drops) {
+    char names[4096], values[4096];
+    FILE *f = fopen("/proc/net/netstat", "r");
+    int found = 0;
+
+    if (f == NULL) {
+        return -1;
+    }
+    // the file pairs a "TcpExt: Name Name ..." line with a "TcpExt: 1 2 ..." line
+    while (fgets(names, sizeof(names), f) != NULL && fgets(values, sizeof(values), f) != NULL) {
+        if (strncmp(names, "TcpExt:", 7) != 0) {
+            continue;
+        }
+        char *ns, *vs;
+        char *n = strtok_r(names, " \n", &ns);
+        char *v = strtok_r(values, " \n", &vs);
+        while ((n = strtok_r(NULL, " \n", &ns)) != NULL && (v = strtok_r(NULL, " \n", &vs)) != NULL) {
+            if (strcmp(n, "ListenOverflows") == 0) {
+                *overflows = strtoull(v, NULL, 10);
+                found++;
+            } else if (strcmp(n, "ListenDrops") == 0) {
+                *drops = strtoull(v, NULL, 10);
+                found++;
+            }
+        }
+        break;
+    }
+    fclose(f);
+    return found == 2 ? 0 : -1;
+}
+
+// a listening socket reports its accept queue through TCP_INFO:
+// tcpi_unacked is the current length and tcpi_sacked the backlog limit
+static int read_queue(int fd, unsigned *len, unsigned *limit) {
+    struct tcp_info ti;
+    socklen_t tlen = sizeof(ti);
+
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &tlen) < 0) {
+        return -1;
+    }
+    *len = ti.tcpi_unacked;
+    *limit = ti.tcpi_sacked;
+    return 0;
+}
+
+static void dump_accept(FILE *out) {
+    unsigned long long overflows = 0, drops = 0;
+    unsigned len = 0, limit = 0;
+
+    fprintf(out, "Server Accept: %llu accepted in %llu wakeups (max batch %llu)  fd limit hit %llu",
+            (unsigned long long)accepted, (unsigned long long)wakeups,
+            (unsigned long long)max_batch, (unsigned long long)fd_exhausted);
+    if (listen_fd >= 0 && read_queue(listen_fd, &len, &limit) == 0) {
+        fprintf(out, "  queue %u/%u", len, limit);
+    }
+    if (read_listen_counters(&overflows, &drops) == 0) {
+        fprintf(out, "  listen overflows %llu  drops %llu (host, since start)",
+                overflows - base_overflows, drops - base_drops);
+    }
+    fprintf(out, "\n");
+}
+
+void accept_init(int listenfd, int backlog) {
+    static int registered;  // prefork workers inherit the supervisor's registration
+    unsigned len, limit;
+
+    if (spare_fd < 0) {
+        spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    // only TCP listeners report their queue; a --unix listener is counted but not shown
+    if (read_queue(listenfd, &len, &limit) == 0) {
+        listen_fd = listenfd;
+        if (limit < (unsigned)backlog) {
+            printf("Server: Backlog %d Capped at %u by net.core.somaxconn\n", backlog, limit);
+        }
+    }
+    if (!registered) {
+        read_listen_counters(&base_overflows, &base_drops);
+        stats_add_section(dump_accept);
+        registered = 1;
+    }
+}
+
+int accept_shed(int listenfd) {
+    if (spare_fd < 0) {
+        return 0;
+    }
+    close(spare_fd);
+    int fd = accept(listenfd, NULL, NULL);
+    if (fd >= 0) {
+        close(fd);
+        fd_exhausted++;
+    }
+    spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return fd >= 0;
+}
+
+int accept_drain(int listenfd, int flags, void (*handle)(int fd, void *arg), void *arg) {
+    int n = 0;
+
+    while (1) {
+        int fd = accept4(listenfd, NULL, NULL, flags);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;  // interrupted, or the client gave up while queued
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                accept_shed(listenfd);
+                break;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Server: Accept Failed.");
+            }
+            break;
+        }
+        n++;
+        handle(fd, arg);
+    }
+    if (n > 0) {
+        accept_count(n);
+    }
+    return n;
+}
+
+void accept_count(int n) {
+    accepted += n;
+    wakeups++;
+    if ((uint64_t)n > max_batch) {
+        max_batch = n;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef ACCEPT_H
+#define ACCEPT_H
+
+// accept path shared by the TCP modes: drain the listen queue with accept4() on
+// every wakeup and keep counters, printed as a stats_dump() section, that show
+// whether connection storms overflow the queue
+
+// remember the listener for the dump and check the backlog the kernel granted;
+// called by create_listener()
+void accept_init(int listenfd, int backlog);
+
+// accept4(listenfd, flags) until the queue is empty, handing every new fd to
+// handle(fd, arg); listenfd must be non-blocking; returns the number accepted
+int accept_drain(int listenfd, int flags, void (*handle)(int fd, void *arg), void *arg);
+
+// out of descriptors (EMFILE/ENFILE): the connection stays queued and the listener
+// stays readable, so give up a spare fd long enough to accept it and close it at once;
+// returns 1 if a connection was dropped, 0 if none was queued
+int accept_shed(int listenfd);
+
+// count connections accepted elsewhere (io_uring multishot accept)
+void accept_count(int n);
+
+#endif // ACCEPT_H
@@ -0,0 +1,318 @@
+// affinity.c - event loop placement: CPU pinning, NIC queue IRQ CPUs, NUMA memory
+#define _GNU_SOURCE  // sched_setaffinity(), CPU_SET()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>  // MPOL_*; mbind() and set_mempolicy() go through syscall(), no libnuma
+
+#include "affinity.h"
+#include "stats.h"
+
+#define MAX_NODES 64  // nodes a one-word node mask can name
+
+// where one loop runs
+struct placed {
+    int cpu;
+    int node;
+    int irq;    // --irq-affinity: a queue IRQ the CPU serves, else -1
+    pid_t tid;  // thread placed here, 0 until placement_apply()
+};
+
+static struct placed *layout;  // one entry per loop; NULL without placement
+static int nloops;
+static const char *loop_label;
+static int numa;
+static __thread int my_node = -1;
+
+// --cpus=0-3,8: CPUs in the order given
+static int parse_cpulist(const char *s, int *cpus, int max) {
+    int n = 0;
+
+    while (*s != '\0') {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s || lo < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo) {
+                return -1;
+            }
+        }
+        for (long c = lo; c <= hi; c++) {
+            if (c >= CPU_SETSIZE || n == max) {
+                return -1;
+            }
+            cpus[n++] = c;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        s = end;
+    }
+    return n;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// first CPU an IRQ is delivered to; effective_affinity_list is what the interrupt
+// controller really uses, smp_affinity_list the requested mask on older kernels
+static int irq_cpu(int irq) {
+    static const char *const files[] = { "effective_affinity_list", "smp_affinity_list" };
+    char path[64], line[256];
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "/proc/irq/%d/%s", irq, files[i]);
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        int ok = fgets(line, sizeof(line), f) != NULL && isdigit((unsigned char)line[0]);
+        fclose(f);
+        if (ok) {
+            return atoi(line);
+        }
+    }
+    return -1;
+}
+
+// --irq-affinity=eth0: the CPUs the NIC's MSI vectors (one per queue, plus any
+// admin vector) are delivered to, in vector order, each CPU once
+static int parse_irq_cpus(const char *iface, int *cpus, int *irqs, int max) {
+    char path[128];
+    int vec[CPU_SETSIZE], nvec = 0, n = 0;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/msi_irqs", iface);
+    DIR *d = opendir(path);
+    if (d == NULL) {
+        return -1;
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL && nvec < CPU_SETSIZE) {
+        if (isdigit((unsigned char)e->d_name[0])) {
+            vec[nvec++] = atoi(e->d_name);
+        }
+    }
+    closedir(d);
+    qsort(vec, nvec, sizeof(vec[0]), cmp_int);
+
+    for (int i = 0; i < nvec && n < max; i++) {
+        int cpu = irq_cpu(vec[i]), seen = 0;
+        for (int j = 0; j < n && !seen; j++) {
+            seen = cpus[j] == cpu;
+        }
+        if (cpu >= 0 && cpu < CPU_SETSIZE && !seen) {
+            irqs[n] = vec[i];
+            cpus[n++] = cpu;
+        }
+    }
+    return n;
+}
+
+// the node a CPU belongs to: its sysfs directory links to it as "nodeN"
+static int cpu_node(int cpu) {
+    char path[64];
+    int node = 0;  // a kernel without NUMA has one implicit node
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *d = opendir(path);
+    if (d == NULL) {
+        return 0;
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (strncmp(e->d_name, "node", 4) == 0 && isdigit((unsigned char)e->d_name[4])) {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+// CPU a thread last ran on: field 39 of its stat line
+static int running_on(pid_t tid) {
+    char path[64], line[1024];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int)tid);
+    if ((f = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    char *p = fgets(line, sizeof(line), f) != NULL ? strrchr(line, ')') : NULL;  // comm may hold spaces
+    fclose(f);
+    for (int field = 2; p != NULL && field < 39; field++) {
+        p = strchr(p + 1, ' ');
+    }
+    return p != NULL ? atoi(p + 1) : -1;
+}
+
+// resident pages per node over the whole process, from /proc/self/numa_maps
+static void dump_node_pages(FILE *out) {
+    unsigned long long pages[MAX_NODES] = { 0 };
+    char line[4096];
+    FILE *f = fopen("/proc/self/numa_maps", "r");
+
+    if (f == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        for (char *p = strstr(line, " N"); p != NULL; p = strstr(p + 1, " N")) {
+            int node;
+            unsigned long long n;
+            if (sscanf(p, " N%d=%llu", &node, &n) == 2 && node >= 0 && node < MAX_NODES) {
+                pages[node] += n;
+            }
+        }
+    }
+    fclose(f);
+    fprintf(out, "Server Placement: resident pages by node:");
+    for (int i = 0; i < MAX_NODES; i++) {
+        if (pages[i] > 0) {
+            fprintf(out, " N%d=%llu", i, pages[i]);
+        }
+    }
+    fprintf(out, "\n");
+}
+
+static void dump_placement(FILE *out) {
+    for (int i = 0; i < nloops; i++) {
+        const struct placed *p = &layout[i];
+        pid_t tid = __atomic_load_n(&p->tid, __ATOMIC_RELAXED);
+        if (tid == 0) {
+            continue;  // another worker process's loop, or not started yet
+        }
+        fprintf(out, "Server Placement: %s %d  cpu %d  node %d", loop_label, i, p->cpu, p->node);
+        if (p->irq >= 0) {
+            fprintf(out, "  irq %d", p->irq);
+        }
+        fprintf(out, "  running on cpu %d%s\n", running_on(tid), numa ? "  memory on its node" : "");
+    }
+    if (numa) {
+        dump_node_pages(out);
+    }
+}
+
+void placement_init(const struct server_config *cfg, int loops, const char *label) {
+    int cpus[CPU_SETSIZE], irqs[CPU_SETSIZE], n;
+    cpu_set_t allowed;
+
+    if (cfg->cpus == NULL && cfg->irq_iface == NULL) {
+        return;
+    }
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        irqs[i] = -1;
+    }
+    if (cfg->irq_iface != NULL) {
+        n = parse_irq_cpus(cfg->irq_iface, cpus, irqs, CPU_SETSIZE);
+        if (n <= 0) {
+            fprintf(stderr, "Server: No Queue IRQs Found for %s"
+                            " (needs a PCI NIC with MSI vectors, see /sys/class/net/%s/device)\n",
+                    cfg->irq_iface, cfg->irq_iface);
+            exit(EXIT_FAILURE);
+        }
+    } else if ((n = parse_cpulist(cfg->cpus, cpus, CPU_SETSIZE)) <= 0) {
+        fprintf(stderr, "Server: Bad CPU List '%s' (e.g. 0-3,8)\n", cfg->cpus);
+        exit(EXIT_FAILURE);
+    }
+
+    // a CPU outside the process's mask (offline, or excluded by taskset/cgroups)
+    // would make sched_setaffinity() fail in every loop
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        perror("Server: sched_getaffinity");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n; i++) {
+        if (!CPU_ISSET(cpus[i], &allowed)) {
+            fprintf(stderr, "Server: CPU %d Is Not Available to This Process\n", cpus[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    layout = calloc(loops, sizeof(*layout));
+    if (layout == NULL) {
+        perror("Server: Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+    nloops = loops;
+    loop_label = label;
+    numa = cfg->numa;
+    for (int i = 0; i < loops; i++) {
+        layout[i].cpu = cpus[i % n];
+        layout[i].irq = irqs[i % n];
+        layout[i].node = cpu_node(layout[i].cpu);
+        if (numa && layout[i].node >= MAX_NODES) {
+            fprintf(stderr, "Server: --numa Supports Nodes 0..%d, CPU %d Is on Node %d\n",
+                    MAX_NODES - 1, layout[i].cpu, layout[i].node);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < loops; i++) {
+        printf("Server: Placing %s %d on CPU %d (node %d", label, i, layout[i].cpu, layout[i].node);
+        if (layout[i].irq >= 0) {
+            printf(", %s IRQ %d", cfg->irq_iface, layout[i].irq);
+        }
+        printf("%s)\n", numa ? ", memory on node" : "");
+    }
+    if (loops > n) {
+        printf("Server: %d %s Loops Share %d CPU(s)\n", loops, label, n);
+    }
+    stats_add_section(dump_placement);
+}
+
+void placement_apply(int id) {
+    static int warned;
+    struct placed *p;
+    cpu_set_t set;
+
+    if (layout == NULL) {
+        return;
+    }
+    p = &layout[id];
+    CPU_ZERO(&set);
+    CPU_SET(p->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {  // 0 is the calling thread
+        perror("Server: sched_setaffinity");
+        exit(EXIT_FAILURE);
+    }
+    if (numa) {
+        // preferred rather than bound: a full node spills over instead of failing
+        unsigned long mask = 1UL << p->node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, MAX_NODES + 1) < 0) {
+            if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+                perror("Server: set_mempolicy (continuing with first-touch placement)");
+            }
+        } else {
+            my_node = p->node;
+        }
+    }
+    __atomic_store_n(&p->tid, (pid_t)syscall(SYS_gettid), __ATOMIC_RELAXED);
+}
+
+int placement_node(void) {
+    return my_node;
+}
+
+void numa_bind(void *addr, size_t len, int node) {
+    static int warned;
+    unsigned long mask = 1UL << node;
+
+    // MPOL_MF_MOVE also migrates pages malloc() recycled from another node's loop
+    if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask, MAX_NODES + 1, MPOL_MF_MOVE) < 0 &&
+        !__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+        perror("Server: mbind (continuing without binding buffers)");
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+
+#include "server.h"
+
+// --cpus, --irq-affinity and --numa: where each event loop runs and allocates.
+// Loop i is pinned to the i-th CPU of the list, wrapping around when there are
+// more loops than CPUs. --irq-affinity takes the list from the CPUs that serve a
+// NIC's queue interrupts, so each loop handles its packets on the core that
+// received them. With --numa a loop also prefers its CPU's NUMA node for every
+// page it touches, and the slab pools bind their slabs there with mbind().
+
+// work out the layout for `loops` event loops named "<label> <i>", print it and
+// add it to the SIGUSR1 dump; exits on a bad CPU list or an interface without IRQs
+void placement_init(const struct server_config *cfg, int loops, const char *label);
+
+// place the calling thread as loop `id`: first thing in every loop thread or
+// worker process; does nothing when no placement was asked for
+void placement_apply(int id);
+
+// NUMA node the calling thread's memory goes to, -1 without --numa
+int placement_node(void);
+
+// bind page-aligned memory to `node` and move pages already touched there
+void numa_bind(void *addr, size_t len, int node);
+
+#endif // AFFINITY_H
@@ -0,0 +1,129 @@
+// bench_readline.c - syscalls per line: byte-at-a-time readline() vs struct linebuf
+//
+// A child process writes <lines> lines of <size> bytes into one end of a
+// socketpair; the parent reads them back with each reader. The binary is
+// linked with -Wl,--wrap=recv so every recv() made by either reader is counted.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "server.h"
+#include "linebuf.h"
+
+static unsigned long recv_calls;  // recv() invocations since last reset
+
+ssize_t __real_recv(int fd, void *buf, size_t len, int flags);
+
+// counting shim installed by the linker in place of recv()
+ssize_t __wrap_recv(int fd, void *buf, size_t len, int flags) {
+    recv_calls++;
+    return __real_recv(fd, buf, len, flags);
+}
+
+// the original one-byte-per-recv() readline() from server.c, kept for comparison
+static ssize_t readline_bytewise(int fd, char *vptr, size_t maxlen) {
+    ssize_t n, rc;
+    char c, *ptr = vptr;
+
+    for (n = 1; n < maxlen; n++) {
+        if ((rc = recv(fd, &c, 1, 0)) == 1) {
+            *ptr++ = c;
+            if (c == '\n') {
+                *ptr = 0;
+                return n;
+            }
+        } else if (rc == 0) {
+            *ptr = 0;
+            return n - 1;
+        } else {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+    }
+    *ptr = 0;
+    return n;
+}
+
+// fork a writer that sends `lines` lines of `size` bytes (newline included)
+static pid_t start_writer(int fd, int lines, int size) {
+    fflush(stdout);  // keep the child from repeating buffered result rows
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    char *line = malloc(size);
+    memset(line, 'x', size - 1);
+    line[size - 1] = '\n';
+    for (int i = 0; i < lines; i++) {
+        size_t off = 0;
+        while (off < (size_t)size) {
+            ssize_t n = send(fd, line + off, size - off, 0);
+            if (n < 0) {
+                exit(EXIT_FAILURE);
+            }
+            off += n;
+        }
+    }
+    exit(0);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// read every line with the chosen reader and print one result row
+static void run(const char *name, int use_linebuf, int lines, int size) {
+    int sv[2];
+    char buf[MAXLINE];
+    char rbuf[LINEBUF_SIZE];
+    struct linebuf lb;
+    long got = 0;
+    ssize_t n;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        exit(EXIT_FAILURE);
+    }
+    pid_t pid = start_writer(sv[1], lines, size);
+    close(sv[1]);
+
+    linebuf_init(&lb, rbuf, sizeof(rbuf));
+    recv_calls = 0;
+    double t0 = now_sec();
+    while ((n = use_linebuf ? linebuf_readline(&lb, sv[0], buf, MAXLINE)
+                            : readline_bytewise(sv[0], buf, MAXLINE)) > 0) {
+        if (buf[n - 1] == '\n') {
+            got++;
+        }
+    }
+    double elapsed = now_sec() - t0;
+
+    close(sv[0]);
+    waitpid(pid, NULL, 0);
+
+    printf("%-10s %8d %8ld %12lu %12.3f %12.0f\n", name, size, got, recv_calls,
+           (double)recv_calls / (got ? got : 1), got / elapsed);
+}
+
+int main(int argc, char **argv) {
+    int lines = argc > 1 ? atoi(argv[1]) : 100000;
+    static const int sizes[] = { 8, 64, 256, 1000 };
+
+    printf("%-10s %8s %8s %12s %12s %12s\n", "reader", "linelen", "lines", "recv_calls",
+           "recv/line", "lines/sec");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        run("bytewise", 0, lines, sizes[i]);
+        run("linebuf", 1, lines, sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// bench_scan.c - newline scanning speed: byte loop vs memchr() vs SSE2 vs AVX2
+//
+// Fills a buffer with lines of each size and times how long every scanner takes
+// to find all of their newlines, the way linebuf_line() walks a receive buffer.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scan.h"
+
+#define BUF_BYTES (16 << 20)  // scanned per pass; larger than the caches
+#define MIN_SECONDS 0.2       // repeat passes until at least this much time
+
+static const char *scan_memchr(const char *p, size_t len) {
+    return memchr(p, '\n', len);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// find every line in buf; returns the number found
+static size_t scan_all(scan_fn fn, const char *buf, size_t len) {
+    const char *p = buf, *end = buf + len, *nl;
+    size_t lines = 0;
+
+    while ((nl = fn(p, end - p)) != NULL) {
+        lines++;
+        p = nl + 1;
+    }
+    return lines;
+}
+
+static void run(const char *name, scan_fn fn, const char *buf, size_t len, size_t expect,
+                int linelen) {
+    size_t lines = 0;
+    int passes = 0;
+    double t0 = now_sec(), elapsed;
+
+    if (fn == NULL) {
+        printf("%-8s %8d %12s\n", name, linelen, "unsupported");
+        return;
+    }
+    do {
+        lines += scan_all(fn, buf, len);
+        passes++;
+        elapsed = now_sec() - t0;
+    } while (elapsed < MIN_SECONDS);
+
+    if (lines != expect * passes) {
+        fprintf(stderr, "%s: found %zu lines, expected %zu\n", name, lines / passes, expect);
+        exit(EXIT_FAILURE);
+    }
+    printf("%-8s %8d %12.2f %12.2f\n", name, linelen, elapsed * 1e9 / lines,
+           (double)len * passes / elapsed / 1e9);
+}
+
+int main(void) {
+    static const int sizes[] = { 8, 64, 256, 1024, 4096, 16384, 65536 };
+    char *buf = malloc(BUF_BYTES);
+
+    if (buf == NULL) {
+        perror("Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+    printf("scan_newline() dispatches to: %s\n", scan_impl());
+    printf("%-8s %8s %12s %12s\n", "scanner", "linelen", "ns/line", "GB/s");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int linelen = sizes[s];
+        size_t lines = BUF_BYTES / linelen;
+        size_t len = lines * linelen;
+
+        for (size_t i = 0; i < len; i++) {
+            buf[i] = i % linelen == (size_t)linelen - 1 ? '\n' : 'a' + i % 26;
+        }
+        run("byte", scan_byte, buf, len, lines, linelen);
+        run("memchr", scan_memchr, buf, len, lines, linelen);
+        run("sse2", scan_sse2_fn(), buf, len, lines, linelen);
+        run("avx2", scan_avx2_fn(), buf, len, lines, linelen);
+    }
+    free(buf);
+    return 0;
+}
@@ -3,12 +3,19 @@
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 
-// function to create socket and return file descriptor
-int create_socket() {
-    int sock_fd = socket(AF_INET, SOCK_STREAM, 0);  // create socket using TCP (sock_stream)
+#include "soak.h"
+
+// function to create socket and return file descriptor (AF_INET for TCP, AF_UNIX for a path)
+int create_socket(int domain) {
+    int sock_fd = socket(domain, SOCK_STREAM, 0);  // create stream socket (sock_stream)
     if (sock_fd == -1) {  // if socket creation fails
         perror("Creating Socket Failed");  
         exit(EXIT_FAILURE);  
@@ -16,6 +23,29 @@ int create_socket() {
     return sock_fd;  // return socket file descriptor
 }
 
+static int low_latency;  // --low-latency: no Nagle, immediate ACKs, busy-polled reads
+
+// re-arm TCP_QUICKACK; the kernel drops it again on its own
+static void quickack(int socket_fd) {
+    int on = 1;
+    if (low_latency) {
+        setsockopt(socket_fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+    }
+}
+
+// --low-latency socket options: send each line at once and ACK echoes without delay
+static void tune_socket(int socket_fd) {
+    int on = 1, busy_poll = 50;  // microseconds
+
+    if (setsockopt(socket_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) == -1) {
+        perror("TCP_NODELAY Failed");
+    }
+    quickack(socket_fd);
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) == -1) {
+        perror("SO_BUSY_POLL Failed (continuing without it)");  // needs CAP_NET_ADMIN above the sysctl
+    }
+}
+
 // function to connect to server using provided IP and port
 void connect_to_server(int socket_fd, const char *server_ip, int port) {
     struct sockaddr_in serveraddr;  // define server's address structure
@@ -32,36 +62,264 @@ void connect_to_server(int socket_fd, const char *server_ip, int port) {
     printf("Connection Established\n");  // print success message when connection is established
 }
 
+// connect to a server listening on a Unix domain socket (server --unix=PATH)
+void connect_to_unix(int socket_fd, const char *path) {
+    struct sockaddr_un serveraddr;
+
+    memset(&serveraddr, 0, sizeof(serveraddr));
+    serveraddr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(serveraddr.sun_path)) {
+        fprintf(stderr, "Socket Path Too Long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(serveraddr.sun_path, path);
+
+    if (connect(socket_fd, (struct sockaddr *)&serveraddr, sizeof(serveraddr)) == -1) {
+        perror("Connecting to Server Failed");
+        exit(EXIT_FAILURE);
+    }
+    printf("Connection Established\n");
+}
+
+// append data to a growable byte buffer
+static void buffer_append(char **buf, size_t *len, size_t *cap, const char *data, size_t n) {
+    if (*len + n > *cap) {
+        size_t new_cap = *cap ? *cap : 4096;
+        while (new_cap < *len + n) {
+            new_cap *= 2;
+        }
+        char *p = realloc(*buf, new_cap);
+        if (p == NULL) {
+            perror("Out of Memory");
+            exit(EXIT_FAILURE);
+        }
+        *buf = p;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+}
+
+// interactive mode: send one line at a time and wait for all of its echo, however long
 void send_receive_messages(int socket_fd) {
-    char send_buffer[100];  // buffer to hold messages to send
-    char receive_buffer[100];  // buffer to hold messages received from server
+    char *line = NULL;  // grown by getline(), so long lines are sent whole
+    char *echo = NULL;  // the echo collected so far
+    size_t line_cap = 0, echo_len = 0, echo_cap = 0;
+    char chunk[65536];
 
     // loop to send and receive messages
     while (1) {
         printf("Enter Message: ");  // prompt user for input
-        if (fgets(send_buffer, sizeof(send_buffer), stdin) == NULL || feof(stdin)) {  // if EOF encountered, break loop
+        ssize_t len = getline(&line, &line_cap, stdin);
+        if (len < 0) {  // if EOF encountered, break loop
             puts("EOF Encountered - Exiting");  
             break;
         }
 
         // send message to server
-        if (send(socket_fd, send_buffer, strlen(send_buffer), 0) == -1) { // if sending fails
+        ssize_t sent = 0, n = 0;
+        while (sent < len && (n = send(socket_fd, line + sent, len - sent, 0)) > 0) {
+            sent += n;
+        }
+        if (n == -1) { // if sending fails
             perror("Sending Message Failed");  
             continue;  // continue to next loop iteration
         }
 
-        // receive server's response
-        int bytes_received = recv(socket_fd, receive_buffer, sizeof(receive_buffer) - 1, 0);
-        if (bytes_received > 0) {  // if data is received
-            receive_buffer[bytes_received] = '\0';  // nullterminate received string
-            printf("Received: %s", receive_buffer); 
-        } else if (bytes_received == 0) {  // if server closes connection
+        // receive server's response; a long line may come back in several pieces
+        echo_len = 0;
+        while (echo_len < (size_t)len) {
+            n = recv(socket_fd, chunk, sizeof(chunk), 0);
+            quickack(socket_fd);
+            if (n <= 0) {
+                break;
+            }
+            buffer_append(&echo, &echo_len, &echo_cap, chunk, n);
+        }
+        if (echo_len > 0) {  // if data is received
+            printf("Received: %.*s", (int)echo_len, echo);
+        }
+        if (n == 0) {  // if server closes connection
             puts("Server Closed Connection");  
             break;
-        } else {
+        } else if (n < 0) {
             perror("Receiving Message Failed");  // error if receiving fails
         }
     }
+    free(line);
+    free(echo);
+}
+
+// lines sent but not yet echoed, matched in order against the replies
+struct inflight_queue {
+    char **lines;
+    size_t *lens;
+    int head;
+    int count;
+    int depth;
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// batch mode: keep up to `depth` lines from stdin in flight and match echoes in order
+void pipeline_messages(int socket_fd, int depth) {
+    struct inflight_queue q = { .depth = depth };
+    char *out = NULL, *in = NULL, *line = NULL;
+    size_t out_len = 0, out_cap = 0, out_off = 0;
+    size_t in_len = 0, in_cap = 0, line_cap = 0;
+    long sent = 0, matched = 0, mismatched = 0;
+    int stdin_eof = 0, shut = 0;
+    char chunk[65536];
+
+    q.lines = calloc(depth, sizeof(*q.lines));
+    q.lens = calloc(depth, sizeof(*q.lens));
+    if (q.lines == NULL || q.lens == NULL) {
+        perror("Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    double start = now_sec();
+    while (!stdin_eof || q.count > 0) {
+        // top up the window from stdin
+        while (!stdin_eof && q.count < depth) {
+            ssize_t n = getline(&line, &line_cap, stdin);
+            if (n < 0) {
+                stdin_eof = 1;
+                break;
+            }
+            int slot = (q.head + q.count) % depth;
+            q.lines[slot] = strndup(line, n);
+            q.lens[slot] = n;
+            q.count++;
+            buffer_append(&out, &out_len, &out_cap, line, n);
+            sent++;
+        }
+        if (q.count == 0) {
+            break;
+        }
+        // all sent: the server echoes an unterminated last line only once it sees EOF
+        if (stdin_eof && out_len == 0 && !shut) {
+            shutdown(socket_fd, SHUT_WR);
+            shut = 1;
+        }
+
+        struct pollfd pfd = { .fd = socket_fd, .events = POLLIN };
+        if (out_off < out_len) {
+            pfd.events |= POLLOUT;
+        }
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Poll Failed");
+            break;
+        }
+
+        // send as much of the pending output as the socket takes
+        if (pfd.revents & POLLOUT) {
+            ssize_t n = send(socket_fd, out + out_off, out_len - out_off, 0);
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                perror("Sending Message Failed");
+                break;
+            }
+            if (n > 0) {
+                out_off += n;
+                if (out_off == out_len) {
+                    out_off = out_len = 0;
+                }
+            }
+        }
+
+        // read echoes and match complete lines against the oldest sent line
+        if (pfd.revents & (POLLIN | POLLERR | POLLHUP)) {
+            ssize_t n = recv(socket_fd, chunk, sizeof(chunk), 0);
+            quickack(socket_fd);
+            if (n == 0) {
+                puts("Server Closed Connection");
+                break;
+            }
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    continue;
+                }
+                perror("Receiving Message Failed");
+                break;
+            }
+            buffer_append(&in, &in_len, &in_cap, chunk, n);
+
+            size_t off = 0;
+            while (q.count > 0 && in_len - off >= q.lens[q.head]) {
+                size_t len = q.lens[q.head];
+                if (memcmp(in + off, q.lines[q.head], len) == 0) {
+                    matched++;
+                } else {
+                    mismatched++;
+                }
+                printf("Received: %.*s%s", (int)len, in + off, in[off + len - 1] == '\n' ? "" : "\n");
+                free(q.lines[q.head]);
+                q.head = (q.head + 1) % depth;
+                q.count--;
+                off += len;
+            }
+            memmove(in, in + off, in_len - off);
+            in_len -= off;
+        }
+    }
+    double elapsed = now_sec() - start;
+
+    printf("Pipelined %ld Lines (depth %d): %ld matched, %ld mismatched, %.1f lines/sec\n",
+           sent, depth, matched, mismatched, elapsed > 0 ? matched / elapsed : 0.0);
+
+    while (q.count > 0) {
+        free(q.lines[q.head]);
+        q.head = (q.head + 1) % depth;
+        q.count--;
+    }
+    free(q.lines);
+    free(q.lens);
+    free(out);
+    free(in);
+    free(line);
+}
+
+// fill in soak targets: a socket path, or comma-separated server IPs sharing one port
+// (each address has its own local port space, so more addresses allow more sessions)
+static void soak_targets(struct soak_config *sc, const char *host, const char *port) {
+    char *list = strdup(host), *save = NULL;
+
+    if (port == NULL) {
+        struct sockaddr_un *sun = (struct sockaddr_un *)&sc->addr[0];
+        if (strlen(host) >= sizeof(sun->sun_path)) {
+            fprintf(stderr, "Socket Path Too Long: %s\n", host);
+            exit(EXIT_FAILURE);
+        }
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, host);
+        sc->addr_len[0] = sizeof(*sun);
+        sc->ntargets = 1;
+        free(list);
+        return;
+    }
+    for (char *ip = strtok_r(list, ",", &save); ip != NULL; ip = strtok_r(NULL, ",", &save)) {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&sc->addr[sc->ntargets];
+        if (sc->ntargets == SOAK_MAX_TARGETS) {
+            fprintf(stderr, "At Most %d Server Addresses\n", SOAK_MAX_TARGETS);
+            exit(EXIT_FAILURE);
+        }
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(atoi(port));
+        if (inet_pton(AF_INET, ip, &sin->sin_addr) != 1) {
+            fprintf(stderr, "Invalid Server Address '%s'\n", ip);
+            exit(EXIT_FAILURE);
+        }
+        sc->addr_len[sc->ntargets++] = sizeof(*sin);
+    }
+    free(list);
 }
 
 // clean up and close socket
@@ -71,16 +329,85 @@ void cleanup(int socket_fd) {
 }
 
 int main(int argc, char* argv[]) {
-    // check if user has provided server IP and port
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <server_ip> <port>\n", argv[0]);  
+    const char *args[2];
+    int nargs = 0;
+    int depth = 0;  // 0 = interactive, one line at a time
+    struct soak_config sc = {  // --soak: many sessions instead of one
+        .interval_ms = 1000, .size = 64, .report_s = 10, .ramp = 1000, .timeout_s = 10,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--pipeline=", 11) == 0) {
+            depth = atoi(argv[i] + 11);
+        } else if (strcmp(argv[i], "--low-latency") == 0) {
+            low_latency = 1;
+        } else if (strncmp(argv[i], "--soak=", 7) == 0) {
+            sc.sessions = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--interval=", 11) == 0) {
+            sc.interval_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            sc.size = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--script=", 9) == 0) {
+            sc.script = argv[i] + 9;
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            sc.duration = atof(argv[i] + 11);
+        } else if (strncmp(argv[i], "--report=", 9) == 0) {
+            sc.report_s = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--ramp=", 7) == 0) {
+            sc.ramp = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+            sc.timeout_s = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--server-pid=", 13) == 0) {
+            sc.server_pid = atoi(argv[i] + 13);
+        } else if (nargs < 2 && argv[i][0] != '-') {
+            args[nargs++] = argv[i];
+        } else {
+            nargs = -1;
+            break;
+        }
+    }
+
+    // check if user has provided server IP and port, or a socket path; the rest only
+    // matters to --soak and is not checked without it
+    int bad_soak = sc.interval_ms < 1 || sc.size < 2 || sc.duration < 0 || sc.report_s < 1 ||
+                   sc.ramp < 1 || sc.timeout_s < 1;
+    if (nargs < 1 || depth < 0 || sc.sessions < 0 || (sc.sessions > 0 && bad_soak)) {
+        fprintf(stderr, "Usage: %s [--pipeline N] [--low-latency] <server_ip> <port>\n"
+                        "       %s [--pipeline N] <socket_path>\n"
+                        "       %s --soak=SESSIONS [--interval=MS] [--size=BYTES] [--script=FILE]\n"
+                        "          [--duration=SECONDS] [--report=SECONDS] [--ramp=PER_SEC]\n"
+                        "          [--timeout=SECONDS] [--server-pid=PID] [--low-latency]\n"
+                        "          <server_ip[,server_ip...]> <port> | <socket_path>\n",
+                argv[0], argv[0], argv[0]);
         exit(EXIT_FAILURE);  // exit program if args missing
     }
 
-    int server_port = atoi(argv[2]); // convert port to integer
-    int socket_fd = create_socket();
-    connect_to_server(socket_fd, argv[1], server_port); 
-    send_receive_messages(socket_fd);
+    if (sc.sessions > 0) {  // soak test: the sessions are driven from one epoll loop
+        sc.low_latency = low_latency;
+        soak_targets(&sc, args[0], nargs == 2 ? args[1] : NULL);
+        return run_soak(&sc);
+    }
+
+    int socket_fd;
+    if (nargs == 1) {
+        low_latency = 0;  // no Nagle or delayed ACKs on a Unix socket - nothing to tune
+        socket_fd = create_socket(AF_UNIX);
+        connect_to_unix(socket_fd, args[0]);
+    } else {
+        int server_port = atoi(args[1]); // convert port to integer
+        socket_fd = create_socket(AF_INET);
+        if (low_latency) {
+            tune_socket(socket_fd);
+        }
+        connect_to_server(socket_fd, args[0], server_port);
+    }
+    if (depth > 0) {
+        pipeline_messages(socket_fd, depth);  // batch mode: lines from stdin, N in flight
+    } else {
+        send_receive_messages(socket_fd);
+    }
     cleanup(socket_fd);
 
     return 0;  // success execution
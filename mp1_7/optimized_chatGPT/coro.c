@@ -0,0 +1,276 @@
+// coro.c - stackful coroutines on an epoll loop (--mode=coro)
+#undef _FORTIFY_SOURCE  // its __longjmp_chk() refuses to jump onto another stack
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+
+#include "coro.h"
+#include "stats.h"
+
+#define MAX_EVENTS 256  // events handled per epoll_wait() call
+#define SPARE_MAX 1024  // finished stacks kept for reuse; past that they are unmapped
+
+// _setjmp() results: why control came back to the loop
+#define CORO_YIELDED 1
+#define CORO_FINISHED 2
+
+static pthread_mutex_t scheds_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct coro_sched *scheds;
+static size_t page;
+static __thread struct coro_sched *self;  // loop running on this thread
+
+static void dump_scheds(FILE *out) {
+    pthread_mutex_lock(&scheds_lock);
+    for (const struct coro_sched *s = scheds; s != NULL; s = s->next) {
+        fprintf(out, "Server Coro: %-10s live %llu  peak %llu  spawned %llu  switches %llu"
+                     "  stacks %llu x %zu KB (%llu spare, %llu unguarded)\n", s->name,
+                (unsigned long long)s->live, (unsigned long long)s->peak,
+                (unsigned long long)s->spawned, (unsigned long long)s->switches,
+                (unsigned long long)s->stacks, s->stack_size / 1024,
+                (unsigned long long)s->nspare, (unsigned long long)s->unguarded);
+    }
+    pthread_mutex_unlock(&scheds_lock);
+}
+
+// a fault in the guard page is a stack overflow: say so before the core dump
+static void segv_handler(int sig, siginfo_t *si, void *uc) {
+    static const char msg[] = "Server: Coroutine Stack Overflow - Raise --stack-size\n";
+    struct coro_sched *s = self;
+    const char *addr = si->si_addr;
+
+    if (s != NULL && s->current != NULL && addr >= s->current->map &&
+        addr < s->current->map + page) {
+        write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    }
+    signal(SIGSEGV, SIG_DFL);  // the faulting access runs again and kills the process
+}
+
+// the handler needs a stack of its own: the coroutine's is the one that overflowed
+static void install_overflow_handler(void) {
+    stack_t ss = { .ss_size = 64 * 1024 };
+    struct sigaction sa;
+
+    ss.ss_sp = malloc(ss.ss_size);
+    if (ss.ss_sp == NULL || sigaltstack(&ss, NULL) < 0) {
+        perror("Server: sigaltstack");
+        exit(EXIT_FAILURE);
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = segv_handler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, NULL);
+}
+
+void coro_sched_init(struct coro_sched *s, const char *name, size_t stack_size) {
+    static int registered;
+
+    page = sysconf(_SC_PAGESIZE);
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->stack_size = (stack_size + page - 1) & ~(page - 1);
+    s->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (s->epfd < 0) {
+        perror("Server: epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+    self = s;
+    install_overflow_handler();
+
+    pthread_mutex_lock(&scheds_lock);
+    s->next = scheds;
+    scheds = s;
+    pthread_mutex_unlock(&scheds_lock);
+    if (!registered) {
+        registered = 1;
+        stats_add_section(dump_scheds);
+    }
+}
+
+// map a guard page plus the stack; struct coro takes the top of the stack
+static struct coro *stack_new(struct coro_sched *s) {
+    static int warned;
+    size_t len = page + s->stack_size;
+    char *map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    // every guard page splits off a mapping of its own, and vm.max_map_count (65530
+    // by default) caps them; past that, stacks go without rather than fail the spawn
+    if (mprotect(map, page, PROT_NONE) < 0) {
+        if (!warned) {
+            warned = 1;
+            perror("Server: Coroutine Guard Page (raise vm.max_map_count; continuing without)");
+        }
+        s->unguarded++;
+    }
+    struct coro *co = (struct coro *)((uintptr_t)(map + len - sizeof(struct coro)) & ~(uintptr_t)63);
+    co->map = map;
+    s->stacks++;
+    return co;
+}
+
+// a coroutine has returned: keep its stack for the next spawn, or unmap it
+static void stack_free(struct coro_sched *s, struct coro *co) {
+    if (s->nspare < SPARE_MAX) {
+        co->next = s->spare;
+        s->spare = co;
+        s->nspare++;
+        return;
+    }
+    munmap(co->map, page + s->stack_size);
+    s->stacks--;
+}
+
+// first code on a new stack; fn is cleared to mark the coroutine as started
+static void trampoline(void) {
+    struct coro_sched *s = self;
+    struct coro *co = s->current;
+    void (*fn)(void *arg) = co->fn;
+
+    co->fn = NULL;
+    fn(co->arg);
+    _longjmp(s->env, CORO_FINISHED);  // stack_free() runs on the loop's stack
+}
+
+// switch from the loop into a coroutine until it waits, yields or finishes
+static void resume(struct coro_sched *s, struct coro *co) {
+    s->current = co;
+    s->switches++;
+    int why = _setjmp(s->env);
+    if (why == 0) {
+        if (co->fn == NULL) {
+            _longjmp(co->env, 1);
+        }
+        ucontext_t uc;  // only to get onto the new stack; later switches are _longjmp()s
+        getcontext(&uc);
+        uc.uc_stack.ss_sp = co->map + page;
+        uc.uc_stack.ss_size = (char *)co - (co->map + page);
+        uc.uc_link = NULL;
+        makecontext(&uc, trampoline, 0);
+        setcontext(&uc);
+    }
+    s->current = NULL;
+    if (why == CORO_FINISHED) {
+        s->live--;
+        stack_free(s, co);
+    }
+}
+
+static void run_queue_push(struct coro_sched *s, struct coro *co) {
+    co->next = NULL;
+    if (s->run_tail != NULL) {
+        s->run_tail->next = co;
+    } else {
+        s->run_head = co;
+    }
+    s->run_tail = co;
+}
+
+struct coro *coro_spawn(struct coro_sched *s, int fd, void (*fn)(void *arg), void *arg) {
+    struct coro *co = s->spare;
+
+    if (co != NULL) {
+        s->spare = co->next;
+        s->nspare--;
+    } else if ((co = stack_new(s)) == NULL) {
+        return NULL;
+    }
+    co->s = s;
+    co->fd = fd;
+    co->waiting = 0;
+    co->ready = 0;
+    co->fn = fn;
+    co->arg = arg;
+
+    // edge-triggered in both directions, once: waiting costs no epoll_ctl()
+    if (fd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = co };
+        if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            int err = errno;
+            stack_free(s, co);
+            errno = err;
+            return NULL;
+        }
+    }
+    run_queue_push(s, co);
+    s->spawned++;
+    if (++s->live > s->peak) {
+        s->peak = s->live;
+    }
+    return co;
+}
+
+// back to the loop; returns when the loop resumes this coroutine
+static void suspend(struct coro *co) {
+    if (_setjmp(co->env) == 0) {
+        _longjmp(co->s->env, CORO_YIELDED);
+    }
+}
+
+void coro_wait(uint32_t events) {
+    struct coro *co = self->current;
+
+    // an edge that came in while the coroutine was busy would not come again
+    if ((co->ready & (events | EPOLLERR | EPOLLHUP)) == 0) {
+        co->waiting = events;
+        suspend(co);
+        co->waiting = 0;
+    }
+    co->ready &= ~events;  // error and hangup stay: the next call reports them
+}
+
+void coro_yield(void) {
+    struct coro *co = self->current;
+
+    run_queue_push(co->s, co);
+    suspend(co);
+}
+
+void coro_run(struct coro_sched *s) {
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        // only what is queued now: a coroutine that yields again waits for the next round
+        struct coro *last = s->run_tail;
+        while (last != NULL) {
+            struct coro *co = s->run_head;
+            s->run_head = co->next;
+            if (s->run_head == NULL) {
+                s->run_tail = NULL;
+            }
+            resume(s, co);
+            if (co == last) {
+                break;
+            }
+        }
+
+        int n = epoll_wait(s->epfd, events, MAX_EVENTS, s->run_head != NULL ? 0 : -1);
+        if (stats_dump_requested()) {
+            stats_dump(stdout);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Server: epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < n; i++) {
+            struct coro *co = events[i].data.ptr;
+            co->ready |= events[i].events;
+            if (co->waiting != 0 && (co->ready & (co->waiting | EPOLLERR | EPOLLHUP))) {
+                resume(s, co);
+            }
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+
+// stackful coroutines on one epoll loop, for handlers written in the blocking
+// style of response(): a coroutine does its non-blocking I/O, and on EAGAIN calls
+// coro_wait() to sleep until its fd is ready again. Each coroutine watches one fd,
+// registered edge-triggered once at spawn. Stacks are mmap()-ed with a PROT_NONE
+// guard page below them, so an overflow faults instead of overwriting a neighbour.
+// struct coro sits at the top of its own stack, and finished stacks are kept on a
+// free list for the next spawn. A coroutine is started with makecontext() and then
+// switched with _setjmp()/_longjmp(), which skip the signal mask syscalls
+// swapcontext() makes on every switch.
+
+#define CORO_STACK_DEFAULT (32 * 1024)
+#define CORO_STACK_MIN (16 * 1024)      // perror() alone puts an 8 KB buffer on the stack
+#define CORO_STACK_MAX (8 * 1024 * 1024)
+
+struct coro {
+    jmp_buf env;                // where it continues when resumed
+    struct coro_sched *s;
+    char *map;                  // the stack mapping, guard page first
+    int fd;                     // watched fd, -1 for none
+    uint32_t waiting;           // events it sleeps on, 0 while runnable
+    uint32_t ready;             // edges seen since it last waited for them
+    void (*fn)(void *arg);
+    void *arg;
+    struct coro *next;          // run queue or spare list link
+};
+
+// one loop with its coroutines; not thread-safe, like the other event loops
+struct coro_sched {
+    const char *name;
+    int epfd;
+    size_t stack_size;          // usable bytes, a multiple of the page size
+    jmp_buf env;                // the loop, resumed whenever a coroutine yields or ends
+    struct coro *current;
+    struct coro *run_head;      // spawned or yielded, waiting for their turn
+    struct coro *run_tail;
+    struct coro *spare;         // finished coroutines, stacks still mapped
+    uint64_t nspare;
+    uint64_t live;              // coroutines running or waiting
+    uint64_t peak;
+    uint64_t spawned;
+    uint64_t stacks;            // stacks mapped now, spares included
+    uint64_t unguarded;         // stacks mapped without a guard page (vm.max_map_count)
+    uint64_t switches;          // resumes, i.e. context switches into a coroutine
+    struct coro_sched *next;
+};
+
+// set up a loop whose coroutines get `stack_size` byte stacks (rounded up to whole
+// pages) and add it to the SIGUSR1 dump
+void coro_sched_init(struct coro_sched *s, const char *name, size_t stack_size);
+
+// queue fn(arg) to run in a new coroutine watching fd; may be called from a
+// coroutine. Returns NULL when out of memory or mappings
+struct coro *coro_spawn(struct coro_sched *s, int fd, void (*fn)(void *arg), void *arg);
+
+// from a coroutine: sleep until its fd reports any of `events` (EPOLLIN, EPOLLOUT),
+// an error or a hangup. Call it only after the operation hit EAGAIN - an edge that
+// arrived since the last wait makes it return at once
+void coro_wait(uint32_t events);
+
+// from a coroutine: let the others run first, e.g. to retry something later
+void coro_yield(void);
+
+// run the loop forever, dumping stats when SIGUSR1 asks for it
+void coro_run(struct coro_sched *s);
+
+#endif // CORO_H
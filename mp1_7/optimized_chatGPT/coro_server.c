@@ -0,0 +1,178 @@
+// coro_server.c - --mode=coro: response()'s read-then-echo loop, one coroutine per connection
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "server.h"
+#include "linebuf.h"
+#include "stats.h"
+#include "accept.h"
+#include "pool.h"
+#include "coro.h"
+
+// the loop: one thread, like --mode=epoll
+static const struct server_config *config;
+static struct coro_sched sched;
+static struct echo_stats stats;
+static struct buf_pool bufs;  // receive buffers, held only while they have bytes in them
+
+// one read into lb; sleeps while the socket is empty. *drained says the last read
+// emptied the socket queue, so any later data brings a fresh edge and the read that
+// would only return EAGAIN can be skipped. A sleeping session holds no buffer
+static ssize_t co_fill(struct linebuf *lb, int fd, int *drained) {
+    size_t cap;
+
+    while (1) {
+        if (*drained) {
+            if (lb->buf != NULL && linebuf_pending(lb) == 0) {
+                buf_put(&bufs, lb->buf, lb->cap);
+                linebuf_init(lb, NULL, 0);
+            }
+            coro_wait(EPOLLIN);
+            *drained = 0;
+        }
+        if (lb->buf == NULL) {
+            char *buf = buf_get(&bufs, LINEBUF_SIZE, &cap);
+            if (buf == NULL) {
+                perror("Server: Out of Memory");
+                return -1;
+            }
+            linebuf_init(lb, buf, cap);
+        }
+
+        ssize_t n = linebuf_fill(lb, fd);
+        stats.recv_calls++;
+        if (n >= 0) {
+            *drained = n > 0 && lb->end < lb->cap;  // a short read took all there was
+            return n;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            *drained = 1;
+        } else if (errno == ENOBUFS) {
+            // a line that fills the buffer: move it to the next size class
+            char *old = lb->buf, *buf = buf_get(&bufs, linebuf_grow_size(lb, config->max_line), &cap);
+            size_t old_cap = lb->cap;
+            if (buf == NULL) {
+                perror("Server: Out of Memory");
+                return -1;
+            }
+            linebuf_move(lb, buf, cap);
+            buf_put(&bufs, old, old_cap);
+            stats.buf_grows++;
+            if (cap > stats.buf_peak) {
+                stats.buf_peak = cap;
+            }
+        } else if (errno != EINTR) {
+            perror("Server: Read Error");
+            return -1;
+        }
+    }
+}
+
+// writen() that sleeps while the socket buffer is full
+static int co_writen(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        stats.send_calls++;
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                coro_wait(EPOLLOUT);
+            } else if (errno != EINTR) {
+                perror("Server: Error while sending.");
+                return -1;
+            }
+            continue;
+        }
+        if ((size_t)n < len && len - n > stats.queue_peak) {
+            stats.queue_peak = len - n;  // echo the socket did not take at once
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// the connection's whole life, written like response(): read, echo the lines, repeat
+static void session(void *arg) {
+    int fd = (intptr_t)arg;
+    struct linebuf lb;
+    const char *span;
+    size_t len, cap;
+    int eof = 0, drained = 0;  // a new connection may have data queued already
+
+    linebuf_init(&lb, NULL, 0);
+    while (!eof) {
+        ssize_t n = co_fill(&lb, fd, &drained);
+        if (n < 0) {
+            break;
+        }
+        eof = n == 0;
+        if (n > 0 && config->low_latency) {
+            rearm_quickack(fd);
+        }
+        if ((len = collect_lines(&lb, config->max_line, eof, &span, &stats)) > 0 &&
+            co_writen(fd, span, len) < 0) {
+            break;
+        }
+        // a buffer grown for a long line goes back to the usual size once the rest fits
+        if (lb.cap > LINEBUF_SIZE && linebuf_pending(&lb) <= LINEBUF_SIZE) {
+            char *old = lb.buf, *buf = buf_get(&bufs, LINEBUF_SIZE, &cap);
+            size_t old_cap = lb.cap;
+            if (buf != NULL) {
+                linebuf_move(&lb, buf, cap);
+                buf_put(&bufs, old, old_cap);
+            }
+        }
+    }
+    if (lb.buf != NULL) {
+        buf_put(&bufs, lb.buf, lb.cap);
+    }
+    close(fd);  // also drops it from the epoll set
+}
+
+// accept_drain() callback: one coroutine per connection
+static void spawn_session(int fd, void *arg) {
+    tune_connection(fd, config);
+    if (coro_spawn(&sched, fd, session, (void *)(intptr_t)fd) == NULL) {
+        perror("Server: Coroutine Spawn Failed");
+        close(fd);
+    }
+}
+
+// each listener gets a coroutine too, sleeping until connections are queued
+static void acceptor(void *arg) {
+    int listenfd = (intptr_t)arg;
+
+    while (1) {
+        accept_drain(listenfd, SOCK_NONBLOCK | SOCK_CLOEXEC, spawn_session, NULL);
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            coro_wait(EPOLLIN);
+        } else {
+            coro_yield();  // out of fds, one connection shed: more may be queued
+        }
+    }
+}
+
+void run_coro_server(const struct listeners *ls, const struct server_config *cfg) {
+    signal(SIGPIPE, SIG_IGN);  // a vanished peer must not kill the whole server
+
+    config = cfg;
+    stats_register(&stats, "coro");
+    buf_pool_init(&bufs, "coro");
+    coro_sched_init(&sched, "coro", cfg->stack_size);
+    printf("Server: Coroutine Stacks of %zu KB With a Guard Page\n", sched.stack_size / 1024);
+    fflush(stdout);
+    for (int i = 0; i < ls->n; i++) {
+        if (coro_spawn(&sched, ls->fd[i], acceptor, (void *)(intptr_t)ls->fd[i]) == NULL) {
+            perror("Server: Coroutine Spawn Failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    coro_run(&sched);
+}
@@ -0,0 +1,768 @@
+// echo_bench.c - high-concurrency load generator for the MP1 echo servers
+//
+// Opens many connections from one process, keeps up to --pipeline messages
+// in flight on each, verifies every echoed byte and reports throughput plus
+// round-trip latency percentiles. Works against any server in mp1_7/.
+// With --udp each "connection" is a connected UDP socket keeping a window of
+// sequence-numbered datagrams in flight against the server's --mode=udp.
+// With --unix=PATH the connections go to the server's Unix domain socket.
+// With --csv the results come out as one CSV row for scripts (bench.sh).
+#define _GNU_SOURCE  // recvmmsg(), sendmmsg()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+
+#include "hist.h"
+
+#define MAX_EVENTS 1024
+#define RECV_SIZE 65536
+#define DRAIN_SECONDS 5  // how long to wait for outstanding echoes after the run
+#define UDP_BATCH 64     // datagrams per sendmmsg()/recvmmsg() in --udp mode
+#define UDP_HDR 16       // hex sequence number that starts every datagram
+#define UDP_TIMEOUT_NS 200000000ULL  // an echo later than this counts as lost
+#define UDP_SCAN_NS 10000000ULL      // how often windows are checked for lost datagrams
+
+enum bconn_state {
+    BC_CONNECTING,
+    BC_OPEN,
+    BC_CLOSED,
+};
+
+// one benchmark connection
+struct bconn {
+    int fd;
+    int id;
+    enum bconn_state state;
+    uint32_t events;       // epoll interest currently registered
+    uint64_t connect_start;
+    uint64_t send_seq;     // messages completely written
+    uint64_t recv_seq;     // messages completely echoed and verified
+    size_t send_off;       // bytes of message send_seq already written
+    size_t recv_off;       // bytes of message recv_seq already verified
+    uint64_t next_due;     // rate mode: intended start time of the next message
+    uint64_t *sent_at;     // start time of each in-flight message, ring of `pipeline`
+    uint64_t *slot_seq;    // udp: sequence number in each sent_at slot (0 time = free)
+};
+
+// benchmark parameters from the command line
+struct bench_config {
+    const char *host;
+    int port;
+    const char *unix_path;  // --unix: connect here instead of host:port
+    int conns;
+    int size;        // message length including the trailing newline
+    int pipeline;    // messages in flight per connection
+    double rate;     // messages/sec per connection, 0 = as fast as echoes return
+    double duration; // seconds of sending
+    int print_hist;  // dump the full RTT distribution
+    int udp;         // datagrams instead of a byte stream
+    int low_latency; // TCP_NODELAY, TCP_QUICKACK, SO_BUSY_POLL and a spinning wait
+    int spin_us;     // low latency: poll this long before sleeping in epoll_wait()
+    int csv;         // print a CSV header and result row instead of the report
+};
+
+// aggregate results
+struct bench_stats {
+    uint64_t sent;
+    uint64_t echoed;
+    uint64_t mismatched;
+    uint64_t lost;          // connections closed or reset by the server mid-run
+    uint64_t connect_failed;
+    uint64_t connected;
+    uint64_t timed_out;     // udp: no echo within UDP_TIMEOUT_NS
+    uint64_t late;          // udp: echo arrived after being counted as timed out
+    struct hist rtt;        // ns, message start -> last byte echoed
+    struct hist connect;    // ns, connect() -> writable
+};
+
+static struct bench_config cfg;
+static struct bench_stats stats;
+static char *pattern;      // message body source: 'a'..'z' repeating
+static int epfd;
+static int sending = 1;    // cleared when the run time is over
+static char *udp_out;      // udp: datagrams being built for one sendmmsg()
+static char *udp_in;       // udp: receive slots, one byte longer than a datagram to catch oversize
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// body bytes of message `seq` on connection `id` start at this offset of `pattern`
+static const char *body_of(const struct bconn *c, uint64_t seq) {
+    return pattern + (c->id + seq) % 26;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--conns=N] [--size=BYTES] [--pipeline=N] [--rate=MSG_PER_SEC]\n"
+            "       [--duration=SECONDS] [--hist] [--udp] [--low-latency] [--spin=USEC] [--csv]\n"
+            "       <server_ip> <port> | --unix=PATH\n"
+            "  --conns     concurrent connections (default 100)\n"
+            "  --size      message size including newline (default 64)\n"
+            "  --pipeline  messages in flight per connection (default 1)\n"
+            "  --rate      messages/sec per connection, 0 = closed loop (default 0)\n"
+            "  --duration  seconds to send for (default 10)\n"
+            "  --hist      print the full RTT percentile distribution\n"
+            "  --udp       UDP datagrams; --conns sockets, --pipeline datagrams in flight each\n"
+            "  --unix      connect to the server's Unix domain socket at PATH\n"
+            "  --low-latency  TCP_NODELAY, TCP_QUICKACK and SO_BUSY_POLL on every connection\n"
+            "  --spin      with --low-latency, poll this long before sleeping (default 50, 0 on one CPU)\n"
+            "  --csv       print the results as a CSV header and one row\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static void parse_args(int argc, char **argv) {
+    const char *pos[2];
+    int npos = 0;
+
+    cfg.conns = 100;
+    cfg.size = 64;
+    cfg.pipeline = 1;
+    cfg.duration = 10;
+    cfg.spin_us = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 50 : 0;  // a lone core spins away the server's time
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--conns=", 8) == 0) {
+            cfg.conns = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            cfg.size = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--pipeline=", 11) == 0) {
+            cfg.pipeline = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            cfg.rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            cfg.duration = atof(argv[i] + 11);
+        } else if (strcmp(argv[i], "--hist") == 0) {
+            cfg.print_hist = 1;
+        } else if (strcmp(argv[i], "--udp") == 0) {
+            cfg.udp = 1;
+        } else if (strncmp(argv[i], "--unix=", 7) == 0) {
+            cfg.unix_path = argv[i] + 7;
+        } else if (strcmp(argv[i], "--low-latency") == 0) {
+            cfg.low_latency = 1;
+        } else if (strncmp(argv[i], "--spin=", 7) == 0) {
+            cfg.spin_us = atoi(argv[i] + 7);
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            cfg.csv = 1;
+        } else if (argv[i][0] == '-' || npos == 2) {
+            usage(argv[0]);
+        } else {
+            pos[npos++] = argv[i];
+        }
+    }
+    if (npos != (cfg.unix_path != NULL ? 0 : 2) || cfg.conns < 1 || cfg.size < 1 || cfg.pipeline < 1 ||
+        cfg.rate < 0 || cfg.duration <= 0 || cfg.spin_us < 0) {
+        usage(argv[0]);
+    }
+    if (cfg.udp && cfg.size < UDP_HDR + 2) {
+        fprintf(stderr, "--udp needs --size of at least %d\n", UDP_HDR + 2);
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.udp && cfg.unix_path != NULL) {
+        fprintf(stderr, "--udp and --unix cannot be combined\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.udp && cfg.csv) {
+        fprintf(stderr, "--udp and --csv cannot be combined\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.unix_path == NULL) {
+        cfg.host = pos[0];
+        cfg.port = atoi(pos[1]);
+    }
+}
+
+// raise the fd limit so thousands of connections fit
+static void raise_fd_limit(void) {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static void set_interest(struct bconn *c, uint32_t want) {
+    if (want == c->events) {
+        return;
+    }
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    if (epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev) == 0) {
+        c->events = want;
+    }
+}
+
+static void bconn_close(struct bconn *c) {
+    if (c->state != BC_CLOSED) {
+        close(c->fd);
+        c->state = BC_CLOSED;
+    }
+}
+
+// re-arm TCP_QUICKACK; the kernel drops it again on its own
+static void quickack(int fd) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+}
+
+// --low-latency: no Nagle delay on requests and busy-polled reads of the echoes
+static void tune_socket(int fd) {
+    static int warned;
+    int on = 1, busy_poll = 50;  // microseconds
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) < 0 && !warned) {
+        perror("SO_BUSY_POLL (continuing without it)");  // needs CAP_NET_ADMIN above the sysctl
+        warned = 1;
+    }
+}
+
+// start a non-blocking connect; completion shows up as EPOLLOUT
+static void bconn_start(struct bconn *c, const struct sockaddr_storage *addr, socklen_t addr_len) {
+    c->fd = socket(addr->ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0) {
+        perror("Creating Socket Failed");
+        c->state = BC_CLOSED;
+        stats.connect_failed++;
+        return;
+    }
+    if (cfg.low_latency && cfg.unix_path == NULL) {  // nothing to tune on a Unix socket
+        tune_socket(c->fd);
+    }
+    c->connect_start = now_ns();
+    if (connect(c->fd, (const struct sockaddr *)addr, addr_len) < 0 && errno != EINPROGRESS) {
+        perror("Connecting to Server Failed");
+        close(c->fd);
+        c->state = BC_CLOSED;
+        stats.connect_failed++;
+        return;
+    }
+    c->state = BC_CONNECTING;
+    c->events = EPOLLOUT;
+    struct epoll_event ev = { .events = c->events, .data.ptr = c };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+// write messages while the pipeline window and the rate schedule allow
+static void bconn_send(struct bconn *c, uint64_t now) {
+    while (c->state == BC_OPEN) {
+        if (c->send_off == 0) {  // about to start a new message
+            if (!sending || c->send_seq - c->recv_seq >= (uint64_t)cfg.pipeline) {
+                break;
+            }
+            if (cfg.rate > 0 && now < c->next_due) {
+                break;
+            }
+            // rate mode measures from the intended start so queueing delay is not hidden
+            c->sent_at[c->send_seq % cfg.pipeline] = cfg.rate > 0 ? c->next_due : now;
+        }
+
+        struct iovec iov[2];
+        size_t body = cfg.size - 1;
+        int iovcnt = 0;
+        if (c->send_off < body) {
+            iov[iovcnt].iov_base = (char *)body_of(c, c->send_seq) + c->send_off;
+            iov[iovcnt++].iov_len = body - c->send_off;
+        }
+        iov[iovcnt].iov_base = "\n";
+        iov[iovcnt++].iov_len = 1;
+
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = iovcnt };
+        ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                set_interest(c, EPOLLIN | EPOLLOUT);  // finish the message when writable
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            stats.lost++;
+            bconn_close(c);
+            return;
+        }
+        c->send_off += n;
+        if (c->send_off == (size_t)cfg.size) {
+            c->send_off = 0;
+            c->send_seq++;
+            stats.sent++;
+            if (cfg.rate > 0) {
+                c->next_due += (uint64_t)(1e9 / cfg.rate);
+            }
+        }
+    }
+    set_interest(c, EPOLLIN);
+}
+
+// verify echoed bytes against what was sent and time completed messages
+static void bconn_recv(struct bconn *c, char *buf) {
+    ssize_t n = recv(c->fd, buf, RECV_SIZE, 0);
+
+    if (n <= 0) {
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (c->recv_seq < c->send_seq || sending) {
+            stats.lost++;  // server went away with messages outstanding
+        }
+        bconn_close(c);
+        return;
+    }
+
+    if (cfg.low_latency && cfg.unix_path == NULL) {
+        quickack(c->fd);
+    }
+    uint64_t now = now_ns();
+    char *p = buf;
+    while (n > 0) {
+        size_t want = cfg.size - c->recv_off;
+        size_t take = (size_t)n < want ? (size_t)n : want;
+        size_t body = cfg.size - 1;
+
+        if (c->recv_seq == c->send_seq && c->recv_off + take > c->send_off) {
+            stats.mismatched++;  // more bytes than were ever sent
+            bconn_close(c);
+            return;
+        }
+
+        // compare against the body part and the trailing newline separately
+        size_t body_take = c->recv_off < body ? (body - c->recv_off < take ? body - c->recv_off : take) : 0;
+        if ((body_take && memcmp(p, body_of(c, c->recv_seq) + c->recv_off, body_take) != 0) ||
+            (take > body_take && p[body_take] != '\n')) {
+            stats.mismatched++;
+            bconn_close(c);
+            return;
+        }
+
+        c->recv_off += take;
+        p += take;
+        n -= take;
+        if (c->recv_off == (size_t)cfg.size) {
+            hist_record(&stats.rtt, now - c->sent_at[c->recv_seq % cfg.pipeline]);
+            c->recv_off = 0;
+            c->recv_seq++;
+            stats.echoed++;
+        }
+    }
+    bconn_send(c, now);
+}
+
+// connect finished (or failed)
+static void bconn_connected(struct bconn *c, uint64_t now) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+        stats.connect_failed++;
+        bconn_close(c);
+        return;
+    }
+    hist_record(&stats.connect, now - c->connect_start);
+    stats.connected++;
+    c->state = BC_OPEN;
+    c->next_due = now;
+    if (cfg.low_latency && cfg.unix_path == NULL) {
+        quickack(c->fd);
+    }
+    bconn_send(c, now);
+}
+
+// udp: open a connected datagram socket; there is no handshake to wait for
+static void udp_start(struct bconn *c, const struct sockaddr_in *addr, uint64_t now) {
+    c->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0) {
+        perror("Creating Socket Failed");
+        c->state = BC_CLOSED;
+        stats.connect_failed++;
+        return;
+    }
+    if (connect(c->fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        perror("Connecting to Server Failed");
+        close(c->fd);
+        c->state = BC_CLOSED;
+        stats.connect_failed++;
+        return;
+    }
+    stats.connected++;
+    c->state = BC_OPEN;
+    c->events = EPOLLIN;
+    c->next_due = now;
+    struct epoll_event ev = { .events = c->events, .data.ptr = c };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+// udp: a socket error such as ECONNREFUSED (nothing listening) ends the socket
+static void udp_error(struct bconn *c, const char *what) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return;
+    }
+    if (stats.lost++ == 0) {
+        perror(what);
+    }
+    bconn_close(c);
+}
+
+// udp: fill free window slots with new datagrams and send them with one sendmmsg()
+static void udp_send(struct bconn *c, uint64_t now) {
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+    uint64_t due = c->next_due;
+    int n = 0;
+
+    memset(msgs, 0, sizeof(msgs));
+    while (sending && c->state == BC_OPEN && n < UDP_BATCH && n < cfg.pipeline &&
+           c->sent_at[(c->send_seq + n) % cfg.pipeline] == 0) {
+        if (cfg.rate > 0) {
+            if (now < due) {
+                break;
+            }
+            due += (uint64_t)(1e9 / cfg.rate);
+        }
+        uint64_t seq = c->send_seq + n;
+        char *d = udp_out + (size_t)n * cfg.size;
+        char hdr[UDP_HDR + 1];
+        snprintf(hdr, sizeof(hdr), "%016llx", (unsigned long long)seq);
+        memcpy(d, hdr, UDP_HDR);
+        memcpy(d + UDP_HDR, body_of(c, seq), cfg.size - UDP_HDR - 1);
+        d[cfg.size - 1] = '\n';
+        iov[n].iov_base = d;
+        iov[n].iov_len = cfg.size;
+        msgs[n].msg_hdr.msg_iov = &iov[n];
+        msgs[n].msg_hdr.msg_iovlen = 1;
+        n++;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    int m = sendmmsg(c->fd, msgs, n, 0);
+    if (m < 0) {
+        udp_error(c, "sendmmsg");
+        set_interest(c, EPOLLIN | EPOLLOUT);  // no room in the socket buffer - retry when writable
+        return;
+    }
+    for (int i = 0; i < m; i++) {
+        int slot = c->send_seq % cfg.pipeline;
+        // rate mode measures from the intended start so queueing delay is not hidden
+        c->sent_at[slot] = cfg.rate > 0 ? c->next_due : now;
+        c->slot_seq[slot] = c->send_seq;
+        c->send_seq++;
+        stats.sent++;
+        if (cfg.rate > 0) {
+            c->next_due += (uint64_t)(1e9 / cfg.rate);
+        }
+    }
+    set_interest(c, m < n ? EPOLLIN | EPOLLOUT : EPOLLIN);
+}
+
+// udp: match a batch of echoes to their window slots by sequence number
+static void udp_recv(struct bconn *c) {
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+    size_t slot_len = cfg.size + 1;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < UDP_BATCH; i++) {
+        iov[i].iov_base = udp_in + i * slot_len;
+        iov[i].iov_len = slot_len;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(c->fd, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+        udp_error(c, "recvmmsg");
+        return;
+    }
+
+    uint64_t now = now_ns();
+    for (int i = 0; i < n; i++) {
+        const char *d = iov[i].iov_base;
+        char hdr[UDP_HDR + 1], *end;
+
+        memcpy(hdr, d, UDP_HDR);
+        hdr[UDP_HDR] = 0;
+        uint64_t seq = strtoull(hdr, &end, 16);
+        if (msgs[i].msg_len != (unsigned)cfg.size || *end != 0 ||
+            memcmp(d + UDP_HDR, body_of(c, seq), cfg.size - UDP_HDR - 1) != 0 ||
+            d[cfg.size - 1] != '\n') {
+            stats.mismatched++;
+            continue;
+        }
+        int slot = seq % cfg.pipeline;
+        if (c->sent_at[slot] == 0 || c->slot_seq[slot] != seq) {
+            stats.late++;  // already written off by udp_expire()
+            continue;
+        }
+        hist_record(&stats.rtt, now - c->sent_at[slot]);
+        c->sent_at[slot] = 0;
+        c->recv_seq++;
+        stats.echoed++;
+    }
+    udp_send(c, now);
+}
+
+// udp: give up on datagrams whose echo is overdue so their window slots can be reused
+static void udp_expire(struct bconn *c, uint64_t now) {
+    for (int slot = 0; slot < cfg.pipeline; slot++) {
+        // sends made after the caller read the clock are stamped later than `now`
+        if (c->sent_at[slot] != 0 && c->sent_at[slot] + UDP_TIMEOUT_NS < now) {
+            c->sent_at[slot] = 0;
+            c->recv_seq++;
+            stats.timed_out++;
+        }
+    }
+    udp_send(c, now);
+}
+
+static void report_udp(double elapsed) {
+    printf("echo_bench: %d udp sockets (%llu ok, %llu failed), %d-byte datagrams, window %d, ",
+           cfg.conns, (unsigned long long)stats.connected,
+           (unsigned long long)stats.connect_failed, cfg.size, cfg.pipeline);
+    if (cfg.rate > 0) {
+        printf("%.0f pkt/s per socket\n", cfg.rate);
+    } else {
+        printf("closed loop\n");
+    }
+    printf("datagrams:   %llu sent, %llu echoed, %llu mismatched, %llu timed out, %llu late, "
+           "%llu sockets failed\n",
+           (unsigned long long)stats.sent, (unsigned long long)stats.echoed,
+           (unsigned long long)stats.mismatched, (unsigned long long)stats.timed_out,
+           (unsigned long long)stats.late, (unsigned long long)stats.lost);
+    printf("throughput:  %.1f pkt/s, %.2f MB/s over %.2f s\n", stats.echoed / elapsed,
+           stats.echoed * (double)cfg.size / elapsed / 1e6, elapsed);
+    hist_summary(&stats.rtt, stdout, "rtt(us):", 1e3);
+    if (cfg.print_hist) {
+        printf("\nRTT distribution (us):\n");
+        hist_print(&stats.rtt, stdout, 1e3);
+    }
+}
+
+// epoll_wait(); --low-latency polls for up to --spin microseconds before sleeping,
+// so an echo that comes back within that window is seen without a wakeup
+static int bench_wait(struct epoll_event *events, int timeout) {
+    if (cfg.low_latency && cfg.spin_us > 0) {
+        uint64_t deadline = now_ns() + cfg.spin_us * 1000ULL;
+        do {
+            int n = epoll_wait(epfd, events, MAX_EVENTS, 0);
+            if (n != 0) {
+                return n;
+            }
+        } while (now_ns() < deadline);
+    }
+    return epoll_wait(epfd, events, MAX_EVENTS, timeout);
+}
+
+static void report(double elapsed) {
+    printf("echo_bench: %d connections (%llu ok, %llu failed), %d-byte messages, pipeline %d, ",
+           cfg.conns, (unsigned long long)stats.connected,
+           (unsigned long long)stats.connect_failed, cfg.size, cfg.pipeline);
+    if (cfg.rate > 0) {
+        printf("%.0f msg/s per connection", cfg.rate);
+    } else {
+        printf("closed loop");
+    }
+    if (cfg.low_latency) {
+        printf(", low latency (spin %d us)", cfg.spin_us);
+    }
+    printf("\n");
+    printf("messages:    %llu sent, %llu echoed, %llu mismatched, %llu connections lost\n",
+           (unsigned long long)stats.sent, (unsigned long long)stats.echoed,
+           (unsigned long long)stats.mismatched, (unsigned long long)stats.lost);
+    printf("throughput:  %.1f msg/s, %.2f MB/s over %.2f s\n", stats.echoed / elapsed,
+           stats.echoed * (double)cfg.size / elapsed / 1e6, elapsed);
+    hist_summary(&stats.connect, stdout, "connect(us):", 1e3);
+    hist_summary(&stats.rtt, stdout, "rtt(us):", 1e3);
+    if (cfg.print_hist) {
+        printf("\nRTT distribution (us):\n");
+        hist_print(&stats.rtt, stdout, 1e3);
+    }
+}
+
+// --csv: the same numbers as report(), latencies in microseconds
+static void report_csv(double elapsed) {
+    printf("conns,connected,connect_failed,size,pipeline,rate,sent,echoed,mismatched,lost,seconds,"
+           "msg_per_s,mb_per_s,connect_p50_us,connect_p99_us,rtt_p50_us,rtt_p90_us,rtt_p99_us,rtt_max_us\n");
+    printf("%d,%llu,%llu,%d,%d,%g,%llu,%llu,%llu,%llu,%.2f,%.1f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+           cfg.conns, (unsigned long long)stats.connected, (unsigned long long)stats.connect_failed,
+           cfg.size, cfg.pipeline, cfg.rate, (unsigned long long)stats.sent,
+           (unsigned long long)stats.echoed, (unsigned long long)stats.mismatched,
+           (unsigned long long)stats.lost, elapsed, stats.echoed / elapsed,
+           stats.echoed * (double)cfg.size / elapsed / 1e6,
+           hist_percentile(&stats.connect, 50) / 1e3, hist_percentile(&stats.connect, 99) / 1e3,
+           hist_percentile(&stats.rtt, 50) / 1e3, hist_percentile(&stats.rtt, 90) / 1e3,
+           hist_percentile(&stats.rtt, 99) / 1e3, stats.rtt.max / 1e3);
+}
+
+int main(int argc, char **argv) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    struct epoll_event events[MAX_EVENTS];
+    char *buf;
+
+    parse_args(argc, argv);
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&addr, 0, sizeof(addr));
+    if (cfg.unix_path != NULL) {
+        struct sockaddr_un *sun = (struct sockaddr_un *)&addr;
+        if (strlen(cfg.unix_path) >= sizeof(sun->sun_path)) {
+            fprintf(stderr, "Socket Path Too Long: %s\n", cfg.unix_path);
+            exit(EXIT_FAILURE);
+        }
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, cfg.unix_path);
+        addr_len = sizeof(*sun);
+    } else {
+        struct sockaddr_in *sin = (struct sockaddr_in *)&addr;
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(cfg.port);
+        if (inet_pton(AF_INET, cfg.host, &sin->sin_addr) != 1) {
+            fprintf(stderr, "Invalid Server Address '%s'\n", cfg.host);
+            exit(EXIT_FAILURE);
+        }
+        addr_len = sizeof(*sin);
+    }
+
+    pattern = malloc(cfg.size + 26);
+    buf = malloc(RECV_SIZE);
+    struct bconn *conns = calloc(cfg.conns, sizeof(*conns));
+    uint64_t *sent_at = calloc((size_t)cfg.conns * cfg.pipeline, sizeof(*sent_at));
+    uint64_t *slot_seq = calloc((size_t)cfg.conns * cfg.pipeline, sizeof(*slot_seq));
+    udp_out = malloc((size_t)UDP_BATCH * cfg.size);
+    udp_in = malloc((size_t)UDP_BATCH * (cfg.size + 1));
+    if (pattern == NULL || buf == NULL || conns == NULL || sent_at == NULL || slot_seq == NULL ||
+        udp_out == NULL || udp_in == NULL) {
+        perror("Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < cfg.size + 26; i++) {
+        pattern[i] = 'a' + i % 26;
+    }
+    hist_init(&stats.rtt);
+    hist_init(&stats.connect);
+
+    epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+
+    // connection storm: every connect is started before any message is sent
+    uint64_t start = now_ns();
+    for (int i = 0; i < cfg.conns; i++) {
+        conns[i].id = i;
+        conns[i].sent_at = sent_at + (size_t)i * cfg.pipeline;
+        conns[i].slot_seq = slot_seq + (size_t)i * cfg.pipeline;
+        if (cfg.udp) {
+            udp_start(&conns[i], (struct sockaddr_in *)&addr, start);
+        } else {
+            bconn_start(&conns[i], &addr, addr_len);
+        }
+    }
+    if (cfg.udp) {
+        for (int i = 0; i < cfg.conns; i++) {
+            udp_send(&conns[i], start);
+        }
+    }
+
+    uint64_t stop_at = start + (uint64_t)(cfg.duration * 1e9);
+    uint64_t drain_until = stop_at + DRAIN_SECONDS * 1000000000ULL;
+    uint64_t now = start;
+    uint64_t next_scan = start + UDP_SCAN_NS;
+    while (1) {
+        int timeout = cfg.rate > 0 ? 1 : cfg.udp ? 10 : 100;  // rate mode ticks every millisecond
+        int n = bench_wait(events, timeout);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+
+        now = now_ns();
+        for (int i = 0; i < n; i++) {
+            struct bconn *c = events[i].data.ptr;
+            if (cfg.udp) {
+                if (c->state == BC_OPEN && (events[i].events & (EPOLLIN | EPOLLERR))) {
+                    udp_recv(c);
+                }
+                if (c->state == BC_OPEN && (events[i].events & EPOLLOUT)) {
+                    udp_send(c, now);
+                }
+            } else if (c->state == BC_CONNECTING) {
+                bconn_connected(c, now);
+            } else if (c->state == BC_OPEN) {
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    bconn_recv(c, buf);
+                }
+                if (c->state == BC_OPEN && (events[i].events & EPOLLOUT)) {
+                    bconn_send(c, now);
+                }
+            }
+        }
+
+        if (sending && now >= stop_at) {
+            sending = 0;  // stop starting messages, wait for the ones in flight
+        }
+        if (cfg.udp && now >= next_scan) {
+            for (int i = 0; i < cfg.conns; i++) {
+                if (conns[i].state == BC_OPEN) {
+                    udp_expire(&conns[i], now);
+                }
+            }
+            next_scan = now + UDP_SCAN_NS;
+        }
+        if (cfg.rate > 0 && sending) {
+            for (int i = 0; i < cfg.conns; i++) {
+                if (conns[i].state == BC_OPEN && cfg.udp) {
+                    udp_send(&conns[i], now);
+                } else if (conns[i].state == BC_OPEN && conns[i].send_off == 0) {
+                    bconn_send(&conns[i], now);
+                }
+            }
+        }
+        if (!sending) {
+            int outstanding = 0;
+            for (int i = 0; i < cfg.conns && !outstanding; i++) {
+                outstanding = conns[i].state == BC_OPEN && conns[i].recv_seq < conns[i].send_seq;
+            }
+            if (!outstanding || now >= drain_until) {
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < cfg.conns; i++) {
+        bconn_close(&conns[i]);
+    }
+    if (cfg.udp) {
+        report_udp((now - start) / 1e9);
+    } else if (cfg.csv) {
+        report_csv((now - start) / 1e9);
+    } else {
+        report((now - start) / 1e9);
+    }
+
+    free(udp_in);
+    free(udp_out);
+    free(slot_seq);
+    free(sent_at);
+    free(conns);
+    free(buf);
+    free(pattern);
+    return stats.mismatched > 0 ? 2 : 0;
+}
@@ -0,0 +1,998 @@
+#define _GNU_SOURCE  // splice(), pipe2(), F_SETPIPE_SZ, MSG_ZEROCOPY
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "server.h"
+#include "linebuf.h"
+#include "stats.h"
+#include "log.h"
+#include "wheel.h"
+#include "accept.h"
+#include "pool.h"
+#include "affinity.h"
+#include "tstamp.h"
+
+#define MAX_EVENTS 256     // events handled per epoll_wait() call
+#define PIPE_SIZE 262144   // per-connection pipe capacity in splice mode
+#define SPLICE_ROUNDS 16   // socket->pipe->socket passes per event before yielding
+#define FLUSH_IOVS 64      // output chunks handed to one sendmsg()
+#define DIRECT_IOVS 16     // --zerocopy: fresh chunks one recvmsg() may fill (64 KB)
+
+// one event loop: an epoll set plus the connections registered in it
+struct reactor {
+    int id;
+    const struct server_config *cfg;
+    int epfd;
+    struct listeners ls;      // accepts itself when ls.n > 0, else fed by an acceptor thread
+    int wakefd;               // eventfd the acceptor signals after queueing fds
+    pthread_mutex_t lock;     // protects the handoff queue
+    int *handoff;             // accepted fds waiting to be registered
+    size_t handoff_len;
+    size_t handoff_cap;
+    int nconns;               // live connections, read by the acceptor for least-load
+    pthread_t thread;
+    struct echo_stats stats;  // echo path counters for this loop
+    char name[24];            // "reactor " and any int
+    struct timer_wheel idle;  // --idle-timeout: one entry per connection
+    uint64_t now_ms;          // wheel clock, read once per epoll_wait()
+    struct slab_pool conns;   // struct conn
+    struct slab_pool chunks;  // struct outchunk
+    struct buf_pool bufs;     // receive buffers, held only while they have bytes in them
+    struct tstamp_hists *ts;  // --timestamps: this loop's stage histograms, else NULL
+    struct slab_pool tstamps; // ...and struct tstamp_conn, kept out of struct conn
+};
+
+static char wake_tag;                    // epoll data.ptr of the wakeup eventfd
+static char listen_tag[MAX_LISTENERS];   // ...and of each listener, indexed like ls.fd[]
+
+// one link of a connection's output queue
+struct outchunk {
+    struct outchunk *next;
+    size_t off;              // bytes already sent
+    size_t len;              // bytes filled
+    int zc;                  // went out in a MSG_ZEROCOPY send...
+    uint32_t zc_id;          // ...with this id; must stay intact until it completes
+    char data[LINEBUF_SIZE];
+};
+
+// per-connection state for the event loop
+struct conn {
+    struct reactor *r;  // owning reactor - a connection never changes threads
+    int fd;
+    struct linebuf in;  // received bytes not yet echoed; in.buf is NULL while empty
+    struct outchunk *out_head;  // echoed bytes the socket could not take yet
+    struct outchunk *out_tail;
+    size_t queued;      // bytes in the output queue
+    int paused;         // stopped reading: queue passed the high watermark
+    int eof;            // peer has shut down its side
+    uint32_t events;    // epoll interest currently registered
+    int pipefd[2];      // splice mode: socket -> pipe -> same socket
+    size_t piped;       // bytes sitting in the pipe
+    struct timer_node idle;  // idle timer, re-armed lazily from last_active
+    uint64_t last_active;    // ms of the last event on this connection
+    int zerocopy;            // SO_ZEROCOPY is on: large flushes use MSG_ZEROCOPY
+    uint32_t zc_next;        // id the kernel gives the next MSG_ZEROCOPY send
+    uint32_t zc_done;        // every send id below this has completed
+    struct outchunk *zc_head;  // fully sent chunks the kernel may still be reading
+    struct outchunk *zc_tail;
+    int closing;             // closed, lingering until its zero-copy sends complete
+    int burst;               // last direct read filled every chunk offered - offer more
+    int line_start;          // direct reads: next byte starts a new line...
+    int line_logged;         // ...and the line in progress was picked for logging
+    struct tstamp_conn *ts;  // --timestamps on this connection, else NULL
+};
+
+// nonzero while the kernel may still read this chunk for a zero-copy send
+static int zc_pending(const struct conn *c, const struct outchunk *ch) {
+    return ch->zc && (int32_t)(ch->zc_id - c->zc_done) >= 0;
+}
+
+// a chunk has been sent completely: free it, or park it until its zero-copy send completes
+static void chunk_retire(struct conn *c, struct outchunk *ch) {
+    if (!zc_pending(c, ch)) {
+        slab_free(&c->r->chunks, ch);
+        return;
+    }
+    ch->next = NULL;
+    if (c->zc_tail != NULL) {
+        c->zc_tail->next = ch;
+    } else {
+        c->zc_head = ch;
+    }
+    c->zc_tail = ch;
+}
+
+// read zero-copy completions off the socket error queue and free the chunks they release;
+// TCP completes sends in order, so everything up to the highest id reported is done
+static void conn_zc_reap(struct conn *c) {
+    char control[256];
+
+    while (1) {
+        struct msghdr msg = { .msg_control = control, .msg_controllen = sizeof(control) };
+        if (recvmsg(c->fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;  // EAGAIN: queue empty
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0) {
+                continue;
+            }
+            // ee_info..ee_data is the range of send ids this notification covers
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                c->r->stats.zc_copied += serr->ee_data - serr->ee_info + 1;
+            }
+            if ((int32_t)(serr->ee_data + 1 - c->zc_done) > 0) {
+                c->zc_done = serr->ee_data + 1;
+            }
+        }
+    }
+    while (c->zc_head != NULL && !zc_pending(c, c->zc_head)) {
+        struct outchunk *next = c->zc_head->next;
+        slab_free(&c->r->chunks, c->zc_head);
+        c->zc_head = next;
+    }
+    if (c->zc_head == NULL) {
+        c->zc_tail = NULL;
+    }
+}
+
+// tear down a connection; closing the fd also drops it from the epoll set.
+// Chunks handed to MSG_ZEROCOPY sends may still be read by the kernel, so while
+// any are outstanding the connection lingers and only waits for their completions
+static void conn_close(struct conn *c) {
+    if (!c->closing) {
+        c->closing = 1;
+        wheel_del(&c->r->idle, &c->idle);
+        if (c->pipefd[0] >= 0) {
+            close(c->pipefd[0]);
+            close(c->pipefd[1]);
+        }
+        while (c->out_head != NULL) {
+            struct outchunk *next = c->out_head->next;
+            chunk_retire(c, c->out_head);
+            c->out_head = next;
+        }
+        c->out_tail = NULL;
+        c->queued = 0;
+        if (c->in.buf != NULL) {
+            buf_put(&c->r->bufs, c->in.buf, c->in.cap);
+            c->in.buf = NULL;
+        }
+        if (c->ts != NULL) {
+            slab_free(&c->r->tstamps, c->ts);
+            c->ts = NULL;
+        }
+    }
+    if (c->zc_head != NULL) {
+        if (c->events != EPOLLET) {
+            // no interest left: only the completions' EPOLLERR edge wakes it
+            struct epoll_event ev = { .events = EPOLLET, .data.ptr = c };
+            epoll_ctl(c->r->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+            c->events = EPOLLET;
+        }
+        return;
+    }
+    __atomic_sub_fetch(&c->r->nconns, 1, __ATOMIC_RELAXED);
+    close(c->fd);
+    slab_free(&c->r->conns, c);
+}
+
+// register a new connection with the reactor's epoll set;
+// r->nconns was already bumped by whoever accepted it
+static void conn_open(struct reactor *r, int fd) {
+    struct conn *c = slab_alloc(&r->conns);
+    if (c == NULL) {
+        perror("Server: Out of Memory");
+        __atomic_sub_fetch(&r->nconns, 1, __ATOMIC_RELAXED);
+        close(fd);
+        return;
+    }
+    memset(c, 0, sizeof(*c));
+    c->r = r;
+    c->fd = fd;
+    c->events = EPOLLIN;
+    c->pipefd[0] = c->pipefd[1] = -1;
+    c->line_start = 1;
+    tune_connection(fd, r->cfg);
+
+    if (r->cfg->zerocopy > 0 && !socket_is_unix(fd)) {  // AF_UNIX has no SO_ZEROCOPY
+        static int warned;  // one warning per process, not per connection
+        int on = 1;
+        c->zerocopy = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+        if (!c->zerocopy && !__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+            perror("Server: SO_ZEROCOPY (sending with copies)");
+        }
+    }
+
+    // stamping must be on before the first send, so OPT_ID counts from byte 0
+    if (r->ts != NULL && !socket_is_unix(fd) && (c->ts = slab_alloc(&r->tstamps)) != NULL) {
+        if (tstamp_enable(fd) == 0) {
+            tstamp_conn_init(c->ts);
+        } else {
+            slab_free(&r->tstamps, c->ts);
+            c->ts = NULL;
+        }
+    }
+
+    if (r->cfg->splice) {
+        if (pipe2(c->pipefd, O_NONBLOCK | O_CLOEXEC) < 0) {
+            perror("Server: pipe2");
+            conn_close(c);
+            return;
+        }
+        fcntl(c->pipefd[1], F_SETPIPE_SZ, PIPE_SIZE);  // best effort - default is 64 KB
+    }
+
+    struct epoll_event ev = { .events = c->events, .data.ptr = c };
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("Server: epoll_ctl ADD");
+        conn_close(c);
+        return;
+    }
+
+    if (r->cfg->idle_timeout > 0) {
+        c->last_active = r->now_ms;
+        wheel_add(&r->idle, &c->idle, r->now_ms + r->cfg->idle_timeout * 1000ULL);
+    }
+}
+
+// send as much of the output queue as the socket takes; returns -1 on a fatal socket error.
+// With --zerocopy a flush of at least that many bytes is sent with MSG_ZEROCOPY: the
+// kernel transmits straight from the chunks, which then wait for the completion
+static int conn_flush(struct conn *c) {
+    while (c->out_head != NULL) {
+        struct iovec iov[FLUSH_IOVS];
+        struct msghdr msg = { .msg_iov = iov };
+        struct outchunk *ch;
+        size_t total = 0;
+
+        for (ch = c->out_head; ch != NULL && msg.msg_iovlen < FLUSH_IOVS; ch = ch->next) {
+            iov[msg.msg_iovlen].iov_base = ch->data + ch->off;
+            iov[msg.msg_iovlen].iov_len = ch->len - ch->off;
+            total += ch->len - ch->off;
+            msg.msg_iovlen++;
+        }
+
+        int zc = c->zerocopy && total >= c->r->cfg->zerocopy;
+        uint64_t sent_at = c->ts != NULL ? tstamp_now() : 0;
+        ssize_t n = sendmsg(c->fd, &msg, MSG_NOSIGNAL | (zc ? MSG_ZEROCOPY : 0));
+        c->r->stats.send_calls++;
+        if (n < 0 && zc && errno == ENOBUFS) {
+            // too many completions outstanding (net.core.optmem_max) - copy this batch
+            zc = 0;
+            n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+            c->r->stats.send_calls++;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;  // retry write
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;  // socket full - wait for EPOLLOUT
+            }
+            perror("Server: Error while sending.");
+            return -1;
+        }
+        if (c->ts != NULL && n > 0) {
+            tstamp_sent(c->ts, n, sent_at, c->r->ts);
+        }
+        uint32_t id = 0;
+        if (zc) {
+            id = c->zc_next++;  // the kernel numbers successful zero-copy sends the same way
+            c->r->stats.zc_sends++;
+            c->r->stats.zc_bytes += n;
+        }
+
+        // drop the chunks that went out completely
+        c->queued -= n;
+        while (n > 0) {
+            ch = c->out_head;
+            if (zc) {
+                ch->zc = 1;
+                ch->zc_id = id;
+            }
+            size_t left = ch->len - ch->off;
+            if ((size_t)n < left) {
+                ch->off += n;
+                break;
+            }
+            n -= left;
+            c->out_head = ch->next;
+            chunk_retire(c, ch);
+        }
+        if (c->out_head == NULL) {
+            c->out_tail = NULL;
+        }
+    }
+    return 0;
+}
+
+// append bytes to the output queue, topping up the last chunk first
+static int conn_queue(struct conn *c, const char *data, size_t len) {
+    while (len > 0) {
+        struct outchunk *ch = c->out_tail;
+        if (ch == NULL || ch->len == sizeof(ch->data)) {
+            ch = slab_alloc(&c->r->chunks);
+            if (ch == NULL) {
+                perror("Server: Out of Memory");
+                return -1;
+            }
+            ch->next = NULL;
+            ch->off = ch->len = 0;
+            if (c->out_tail != NULL) {
+                c->out_tail->next = ch;
+            } else {
+                c->out_head = ch;
+            }
+            c->out_tail = ch;
+        }
+        size_t n = sizeof(ch->data) - ch->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(ch->data + ch->len, data, n);
+        ch->len += n;
+        c->queued += n;
+        data += n;
+        len -= n;
+    }
+    if (c->queued > c->r->stats.queue_peak) {
+        c->r->stats.queue_peak = c->queued;
+    }
+    return 0;
+}
+
+// echo a batch of lines with one send(); whatever the socket refuses joins the output queue
+static int conn_send(struct conn *c, const char *data, size_t len) {
+    uint64_t sent_at = 0;
+    ssize_t n = 0;
+
+    if (c->queued == 0) {  // bytes already queued must go out first
+        if (c->ts != NULL) {
+            sent_at = tstamp_now();
+        }
+        do {
+            n = send(c->fd, data, len, MSG_NOSIGNAL);
+            c->r->stats.send_calls++;
+        } while (n < 0 && errno == EINTR);
+
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Server: Error while sending.");
+                return -1;
+            }
+            n = 0;
+        }
+        if (c->ts != NULL && n > 0) {
+            tstamp_sent(c->ts, n, sent_at, c->r->ts);
+        }
+    }
+    return conn_queue(c, data + n, len - n);
+}
+
+// echo every complete line in the input buffer, same framing as readline()
+static int conn_process(struct conn *c) {
+    const char *span;
+    size_t len = collect_lines(&c->in, c->r->cfg->max_line, c->eof, &span, &c->r->stats);
+
+    if (len > 0 && conn_send(c, span, len) < 0) {
+        return -1;
+    }
+    // a client that sends faster than it reads stops being read until its echo drains
+    if (c->queued >= c->r->cfg->high_water && !c->paused) {
+        c->paused = 1;
+        c->r->stats.pauses++;
+    }
+    return 0;
+}
+
+// take a receive buffer from the pool for the next read
+static int conn_hold_input(struct conn *c) {
+    size_t cap;
+
+    if (c->in.buf == NULL) {
+        char *buf = buf_get(&c->r->bufs, LINEBUF_SIZE, &cap);
+        if (buf == NULL) {
+            perror("Server: Out of Memory");
+            return -1;
+        }
+        linebuf_init(&c->in, buf, cap);
+    }
+    return 0;
+}
+
+// move a line that fills the receive buffer to one of the next size class
+static int conn_grow_input(struct conn *c) {
+    size_t cap;
+    char *buf = buf_get(&c->r->bufs, linebuf_grow_size(&c->in, c->r->cfg->max_line), &cap);
+    char *old = c->in.buf;
+    size_t old_cap = c->in.cap;
+
+    if (buf == NULL) {
+        perror("Server: Out of Memory");
+        return -1;
+    }
+    linebuf_move(&c->in, buf, cap);
+    buf_put(&c->r->bufs, old, old_cap);
+    c->r->stats.buf_grows++;
+    if (cap > c->r->stats.buf_peak) {
+        c->r->stats.buf_peak = cap;
+    }
+    return 0;
+}
+
+// give the receive buffer back once every byte in it has been echoed, so an idle
+// connection costs its struct conn and nothing more; a buffer grown for a long line
+// goes back to the usual size as soon as what is left of it fits
+static void conn_drop_input(struct conn *c) {
+    size_t cap;
+
+    if (c->in.buf == NULL) {
+        return;
+    }
+    if (linebuf_pending(&c->in) == 0) {
+        buf_put(&c->r->bufs, c->in.buf, c->in.cap);
+        linebuf_init(&c->in, NULL, 0);
+    } else if (c->in.cap > LINEBUF_SIZE && linebuf_pending(&c->in) <= LINEBUF_SIZE) {
+        char *old = c->in.buf, *buf = buf_get(&c->r->bufs, LINEBUF_SIZE, &cap);
+        size_t old_cap = c->in.cap;
+        if (buf != NULL) {
+            linebuf_move(&c->in, buf, cap);
+            buf_put(&c->r->bufs, old, old_cap);
+        }
+    }
+}
+
+// read what is available from the socket and echo complete lines
+static int conn_read(struct conn *c) {
+    char control[TSTAMP_CONTROL];
+    size_t controllen;
+    ssize_t n;
+    int rc;
+
+    if (conn_hold_input(c) < 0) {
+        return -1;
+    }
+    do {
+        if (c->ts != NULL) {
+            controllen = sizeof(control);
+            n = linebuf_fill_msg(&c->in, c->fd, control, &controllen);
+        } else {
+            n = linebuf_fill(&c->in, c->fd);
+        }
+        c->r->stats.recv_calls++;
+    } while (n < 0 && (errno == EINTR || (errno == ENOBUFS && conn_grow_input(c) == 0)));
+    if (n > 0 && c->r->cfg->low_latency) {
+        rearm_quickack(c->fd);
+    }
+    if (n > 0 && c->ts != NULL) {
+        tstamp_received(c->ts, control, controllen, c->r->ts);
+    }
+
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            conn_drop_input(c);
+            return 0;
+        }
+        perror("Server: Read Error");
+        return -1;
+    }
+    if (n == 0) {
+        c->eof = 1;  // EOF
+    }
+    rc = conn_process(c);
+    conn_drop_input(c);
+    return rc;
+}
+
+// --zerocopy: receive straight into output chunks and echo them as they are, the way
+// the uring mode echoes its buffers; the recv() is then the only copy a large flush costs
+static int conn_read_direct(struct conn *c) {
+    struct outchunk *fresh[DIRECT_IOVS];
+    struct iovec iov[DIRECT_IOVS + 1];
+    struct msghdr msg = { .msg_iov = iov };
+    struct outchunk *tail = c->out_tail;
+    size_t tail_room = tail != NULL ? sizeof(tail->data) - tail->len : 0;
+    int nfresh = c->burst ? DIRECT_IOVS : tail_room == 0;
+    ssize_t n;
+
+    if (tail_room > 0) {  // top up the last chunk, even one a zero-copy send is still reading
+        iov[msg.msg_iovlen].iov_base = tail->data + tail->len;
+        iov[msg.msg_iovlen++].iov_len = tail_room;
+    }
+    for (int i = 0; i < nfresh; i++) {
+        fresh[i] = slab_alloc(&c->r->chunks);
+        if (fresh[i] == NULL) {
+            perror("Server: Out of Memory");
+            nfresh = i;
+            break;
+        }
+        fresh[i]->next = NULL;
+        fresh[i]->off = fresh[i]->len = 0;
+        fresh[i]->zc = 0;
+        iov[msg.msg_iovlen].iov_base = fresh[i]->data;
+        iov[msg.msg_iovlen++].iov_len = sizeof(fresh[i]->data);
+    }
+
+    if (msg.msg_iovlen == 0) {
+        return -1;  // out of memory, already reported
+    }
+    do {
+        n = recvmsg(c->fd, &msg, 0);
+        c->r->stats.recv_calls++;
+    } while (n < 0 && errno == EINTR);
+    if (n > 0 && c->r->cfg->low_latency) {
+        rearm_quickack(c->fd);
+    }
+
+    // hand the filled chunks to the output queue and give back the rest
+    c->burst = n > 0 && (size_t)n == tail_room + nfresh * sizeof(fresh[0]->data);
+    size_t left = n > 0 ? n : 0;
+    for (int i = 0; i < (int)msg.msg_iovlen; i++) {
+        size_t take = left < iov[i].iov_len ? left : iov[i].iov_len;
+        log_stream(iov[i].iov_base, take, &c->line_start, &c->line_logged, &c->r->stats);
+        left -= take;
+    }
+    left = n > 0 ? n : 0;
+    if (tail_room > 0) {
+        size_t take = left < tail_room ? left : tail_room;
+        tail->len += take;
+        left -= take;
+    }
+    for (int i = 0; i < nfresh; i++) {
+        if (left == 0) {
+            slab_free(&c->r->chunks, fresh[i]);
+            continue;
+        }
+        fresh[i]->len = left < sizeof(fresh[i]->data) ? left : sizeof(fresh[i]->data);
+        left -= fresh[i]->len;
+        if (c->out_tail != NULL) {
+            c->out_tail->next = fresh[i];
+        } else {
+            c->out_head = fresh[i];
+        }
+        c->out_tail = fresh[i];
+    }
+
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        perror("Server: Read Error");
+        return -1;
+    }
+    if (n == 0) {
+        c->eof = 1;  // EOF
+        return 0;
+    }
+    c->queued += n;
+    if (c->queued > c->r->stats.queue_peak) {
+        c->r->stats.queue_peak = c->queued;
+    }
+    if (conn_flush(c) < 0) {
+        return -1;
+    }
+    if (c->queued >= c->r->cfg->high_water && !c->paused) {
+        c->paused = 1;
+        c->r->stats.pauses++;
+    }
+    return 0;
+}
+
+// splice mode: move bytes socket -> pipe -> socket without copying them to user space
+static int conn_splice(struct conn *c) {
+    for (int round = 0; round < SPLICE_ROUNDS; round++) {
+        ssize_t n;
+
+        // drain the pipe back into the socket before pulling more in
+        while (c->piped > 0) {
+            n = splice(c->pipefd[0], NULL, c->fd, NULL, c->piped, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            c->r->stats.send_calls++;
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return 0;  // socket full - wait for EPOLLOUT
+                }
+                perror("Server: splice to socket");
+                return -1;
+            }
+            c->piped -= n;
+            c->r->stats.bytes += n;
+        }
+        if (c->eof) {
+            return 0;
+        }
+
+        n = splice(c->fd, NULL, c->pipefd[1], NULL, PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        c->r->stats.recv_calls++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;  // nothing more to read right now
+            }
+            perror("Server: splice from socket");
+            return -1;
+        }
+        if (n == 0) {
+            c->eof = 1;  // EOF
+        }
+        c->piped += n;
+    }
+    return 0;  // level-triggered epoll brings us back for the rest
+}
+
+// register for reading unless paused or at EOF, and for writing while output is queued
+static int conn_update(struct conn *c) {
+    uint32_t want;
+
+    if (c->pipefd[0] >= 0) {
+        want = c->piped > 0 ? EPOLLOUT : EPOLLIN;
+    } else {
+        want = (c->paused || c->eof ? 0 : EPOLLIN) | (c->queued > 0 ? EPOLLOUT : 0);
+    }
+
+    if (want == c->events) {
+        return 0;
+    }
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    if (epoll_ctl(c->r->epfd, EPOLL_CTL_MOD, c->fd, &ev) < 0) {
+        perror("Server: epoll_ctl MOD");
+        return -1;
+    }
+    c->events = want;
+    return 0;
+}
+
+// handle readiness on one connection
+// EPOLLERR/EPOLLHUP need no special case - the next send()/recv() reports them -
+// except that zero-copy completions and transmit stamps also arrive as EPOLLERR and
+// are collected first
+static void conn_event(struct conn *c, uint32_t events) {
+    int rc = 0;
+
+    if ((c->zerocopy || c->ts != NULL) && (events & EPOLLERR)) {
+        if (c->zerocopy) {
+            conn_zc_reap(c);
+        } else {
+            tstamp_reap(c->fd, c->ts, c->r->ts);
+        }
+        // EPOLLERR here is the error queue: zero-copy completions or transmit stamps. A
+        // real socket error also shuts the socket down and comes with EPOLLHUP
+        events &= ~EPOLLERR;
+    }
+    if (c->closing) {
+        conn_close(c);  // lingering: frees it once the last completion is in
+        return;
+    }
+    if (!(events & (EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        return;  // only completions - nothing to read or flush
+    }
+
+    c->last_active = c->r->now_ms;  // just a store - the idle timer catches up when it fires
+
+    if (c->pipefd[0] >= 0) {
+        rc = conn_splice(c);
+    } else {
+        if (c->queued > 0 && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            rc = conn_flush(c);
+            if (c->paused && c->queued <= c->r->cfg->low_water) {
+                c->paused = 0;  // drained below the low watermark - read again
+            }
+        }
+        if (rc == 0 && !c->paused && !c->eof && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+            rc = c->r->cfg->zerocopy > 0 ? conn_read_direct(c) : conn_read(c);
+        }
+    }
+
+    if (rc < 0 || (c->eof && linebuf_pending(&c->in) == 0 && c->queued == 0 && c->piped == 0)) {
+        conn_close(c);
+        return;
+    }
+    if (conn_update(c) < 0) {
+        conn_close(c);
+    }
+}
+
+// accept_drain() callback: add a connection to this reactor's epoll set
+static void accepted(int connfd, void *arg) {
+    struct reactor *r = arg;
+    __atomic_add_fetch(&r->nconns, 1, __ATOMIC_RELAXED);
+    conn_open(r, connfd);
+}
+
+// register the connections the acceptor queued for this reactor
+static void drain_handoff(struct reactor *r) {
+    uint64_t count;
+    int fds[MAX_EVENTS];
+    size_t n;
+
+    if (read(r->wakefd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("Server: eventfd read");
+    }
+
+    do {
+        pthread_mutex_lock(&r->lock);
+        n = r->handoff_len < MAX_EVENTS ? r->handoff_len : MAX_EVENTS;
+        memcpy(fds, r->handoff, n * sizeof(int));  // oldest first: they have waited longest
+        r->handoff_len -= n;
+        memmove(r->handoff, r->handoff + n, r->handoff_len * sizeof(int));
+        pthread_mutex_unlock(&r->lock);
+
+        for (size_t i = 0; i < n; i++) {
+            conn_open(r, fds[i]);
+        }
+    } while (n == MAX_EVENTS);
+}
+
+// add an fd to the reactor's epoll set, tagged with ptr
+static void reactor_watch(struct reactor *r, int fd, void *ptr) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = ptr };
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("Server: epoll_ctl ADD");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// idle timer fired: close the connection, or re-arm if it has been active since
+static void idle_expired(struct timer_node *t, void *arg) {
+    struct reactor *r = arg;
+    struct conn *c = (struct conn *)((char *)t - offsetof(struct conn, idle));
+    uint64_t deadline = c->last_active + r->cfg->idle_timeout * 1000ULL;
+
+    if (deadline > r->now_ms) {
+        wheel_add(&r->idle, &c->idle, deadline);
+        return;
+    }
+    log_write(LOG_INFO, "Server: Closing Connection Idle for %d s\n", r->cfg->idle_timeout);
+    r->stats.idle_closed++;
+    conn_close(c);
+}
+
+// set up a reactor; without listeners connections arrive through the handoff queue
+static void reactor_init(struct reactor *r, int id, const struct listeners *ls,
+                         const struct server_config *cfg) {
+    memset(r, 0, sizeof(*r));
+    r->id = id;
+    r->cfg = cfg;
+    if (ls != NULL) {
+        r->ls = *ls;
+    }
+    r->wakefd = -1;
+
+    snprintf(r->name, sizeof(r->name), "reactor %d", id);
+    stats_register(&r->stats, r->name);
+    slab_init(&r->conns, r->name, "conn", sizeof(struct conn));
+    slab_init(&r->chunks, r->name, "chunk", sizeof(struct outchunk));
+    buf_pool_init(&r->bufs, r->name);
+    if (cfg->timestamps) {
+        r->ts = tstamp_hists_new(r->name);
+        slab_init(&r->tstamps, r->name, "tstamp", sizeof(struct tstamp_conn));
+    }
+    r->now_ms = wheel_now_ms();
+    wheel_init(&r->idle, r->now_ms, WHEEL_TICK_MS);
+
+    r->epfd = epoll_create1(0);
+    if (r->epfd < 0) {
+        perror("Server: epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+
+    if (r->ls.n > 0) {
+        for (int i = 0; i < r->ls.n; i++) {
+            reactor_watch(r, r->ls.fd[i], &listen_tag[i]);  // listeners are already non-blocking
+        }
+    } else {
+        r->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (r->wakefd < 0) {
+            perror("Server: eventfd");
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_init(&r->lock, NULL);
+        reactor_watch(r, r->wakefd, &wake_tag);
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// wait for events; --low-latency first polls without sleeping for up to --spin
+// microseconds, so a reply that arrives within that window skips the wakeup
+static int reactor_wait(struct reactor *r, struct epoll_event *events) {
+    int timeout = wheel_timeout_ms(&r->idle, r->now_ms);
+
+    if (r->cfg->low_latency && r->cfg->spin_us > 0 && timeout != 0) {
+        uint64_t deadline = now_ns() + r->cfg->spin_us * 1000ULL;
+        do {
+            int n = epoll_wait(r->epfd, events, MAX_EVENTS, 0);
+            if (n != 0) {
+                r->stats.spin_hits += n > 0;
+                return n;
+            }
+        } while (now_ns() < deadline);
+        r->stats.spin_sleeps++;
+    }
+    return epoll_wait(r->epfd, events, MAX_EVENTS, timeout);
+}
+
+// run one event loop forever
+static void reactor_loop(struct reactor *r) {
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        int n = reactor_wait(r, events);
+        r->now_ms = wheel_now_ms();
+        if (stats_dump_requested()) {
+            stats_dump(stdout);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Server: epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < n; i++) {
+            char *tag = events[i].data.ptr;
+            if (tag >= listen_tag && tag < listen_tag + MAX_LISTENERS) {
+                accept_drain(r->ls.fd[tag - listen_tag], SOCK_NONBLOCK | SOCK_CLOEXEC, accepted, r);
+            } else if (events[i].data.ptr == &wake_tag) {
+                drain_handoff(r);
+            } else {
+                conn_event(events[i].data.ptr, events[i].events);
+            }
+        }
+        wheel_advance(&r->idle, r->now_ms, idle_expired, r);
+    }
+}
+
+static void *reactor_thread(void *arg) {
+    struct reactor *r = arg;
+    placement_apply(r->id);
+    reactor_loop(r);
+    return NULL;
+}
+
+// serve all connections from one process with a single epoll set
+void run_epoll_server(const struct listeners *ls, const struct server_config *cfg) {
+    struct reactor r;
+
+    signal(SIGPIPE, SIG_IGN);  // a vanished peer must not kill the whole server
+
+    reactor_init(&r, 0, ls, cfg);
+    reactor_loop(&r);
+}
+
+// pick the reactor that gets the next connection
+static struct reactor *pick_reactor(struct reactor *rs, int n, enum balance_policy policy) {
+    static unsigned next;  // only touched by the acceptor thread
+
+    if (policy == BALANCE_LEAST) {
+        struct reactor *best = &rs[0];
+        for (int i = 1; i < n; i++) {
+            if (__atomic_load_n(&rs[i].nconns, __ATOMIC_RELAXED) <
+                __atomic_load_n(&best->nconns, __ATOMIC_RELAXED)) {
+                best = &rs[i];
+            }
+        }
+        return best;
+    }
+    return &rs[next++ % n];
+}
+
+// queue an accepted fd for a reactor and wake it up
+static void handoff(struct reactor *r, int fd) {
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->handoff_len == r->handoff_cap) {
+        size_t cap = r->handoff_cap ? r->handoff_cap * 2 : 64;
+        int *q = realloc(r->handoff, cap * sizeof(int));
+        if (q == NULL) {
+            pthread_mutex_unlock(&r->lock);
+            perror("Server: Out of Memory");
+            close(fd);
+            return;
+        }
+        r->handoff = q;
+        r->handoff_cap = cap;
+    }
+    r->handoff[r->handoff_len++] = fd;
+    pthread_mutex_unlock(&r->lock);
+
+    // count it now so least-load sees connections still queued for the reactor
+    __atomic_add_fetch(&r->nconns, 1, __ATOMIC_RELAXED);
+
+    if (write(r->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("Server: eventfd write");
+    }
+}
+
+// acceptor state for the accept_drain() callback
+struct acceptor {
+    struct reactor *rs;
+    int n;
+    enum balance_policy balance;
+};
+
+static void deal(int connfd, void *arg) {
+    struct acceptor *a = arg;
+    handoff(pick_reactor(a->rs, a->n, a->balance), connfd);
+}
+
+// one reactor thread per core; the main thread accepts and deals connections out
+void run_reactor_server(const struct listeners *ls, const struct server_config *cfg) {
+    int n = cfg->threads;
+    struct reactor *rs = calloc(n, sizeof(*rs));
+    if (rs == NULL) {
+        perror("Server: Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGPIPE, SIG_IGN);  // a vanished peer must not kill the whole server
+
+    for (int i = 0; i < n; i++) {
+        reactor_init(&rs[i], i, NULL, cfg);
+        if (pthread_create(&rs[i].thread, NULL, reactor_thread, &rs[i]) != 0) {
+            perror("Server: pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("Server: %d Reactor Threads (%s balancing)\n", n,
+           cfg->balance == BALANCE_LEAST ? "least-load" : "round-robin");
+    fflush(stdout);
+
+    // accept loop: sleep until the listener is readable, then take the whole queue;
+    // connections stay on the reactor they are handed to
+    struct acceptor a = { .rs = rs, .n = n, .balance = cfg->balance };
+    struct pollfd pfd[MAX_LISTENERS];
+    for (int i = 0; i < ls->n; i++) {
+        pfd[i].fd = ls->fd[i];
+        pfd[i].events = POLLIN;
+    }
+    while (1) {
+        if (poll(pfd, ls->n, -1) < 0) {
+            if (errno != EINTR) {
+                perror("Server: poll");
+            }
+            if (stats_dump_requested()) {  // SIGUSR1 lands here while the reactors sleep
+                stats_dump(stdout);
+            }
+            continue;
+        }
+        for (int i = 0; i < ls->n; i++) {
+            if (pfd[i].revents) {
+                accept_drain(ls->fd[i], SOCK_NONBLOCK | SOCK_CLOEXEC, deal, &a);
+            }
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#include <string.h>
+
+#include "hist.h"
+
+#define HALF (HIST_SUB_COUNT / 2)
+
+// bucket index: values below HIST_SUB_COUNT map 1:1, larger ones keep their top HIST_SUB_BITS bits
+static int value_index(uint64_t v) {
+    int msb = v ? 63 - __builtin_clzll(v) : 0;
+    int shift = msb < HIST_SUB_BITS ? 0 : msb - (HIST_SUB_BITS - 1);
+
+    return shift * HALF + (int)(v >> shift);
+}
+
+// highest value that lands in bucket idx
+static uint64_t index_value(int idx) {
+    if (idx < HIST_SUB_COUNT) {
+        return idx;
+    }
+    int shift = idx / HALF - 1;
+    uint64_t top = idx - shift * HALF;
+    return ((top + 1) << shift) - 1;
+}
+
+void hist_init(struct hist *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_record(struct hist *h, uint64_t value) {
+    h->counts[value_index(value)]++;
+    h->total++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void hist_merge(struct hist *dst, const struct hist *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t hist_percentile(const struct hist *h, double pct) {
+    if (h->total == 0) {
+        return 0;
+    }
+    uint64_t want = (uint64_t)(pct / 100.0 * h->total + 0.5);
+    uint64_t seen = 0;
+
+    if (want < 1) {
+        want = 1;
+    }
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= want) {
+            uint64_t v = index_value(i);
+            return v > h->max ? h->max : v;  // the top bucket is bounded by the real max
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const struct hist *h) {
+    return h->total ? h->sum / h->total : 0.0;
+}
+
+void hist_summary(const struct hist *h, FILE *out, const char *label, double scale) {
+    if (h->total == 0) {
+        fprintf(out, "%-12s no samples\n", label);
+        return;
+    }
+    fprintf(out, "%-12s min %.1f  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+            label, h->min / scale, hist_mean(h) / scale,
+            hist_percentile(h, 50) / scale, hist_percentile(h, 90) / scale,
+            hist_percentile(h, 99) / scale, hist_percentile(h, 99.9) / scale, h->max / scale);
+}
+
+// number of samples recorded at or below value
+static uint64_t count_at_or_below(const struct hist *h, uint64_t value) {
+    uint64_t seen = 0;
+    int last = value_index(value);
+
+    for (int i = 0; i <= last && i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+    }
+    return seen;
+}
+
+static void print_row(const struct hist *h, FILE *out, double scale, double frac) {
+    uint64_t v = hist_percentile(h, frac * 100.0);
+    uint64_t seen = count_at_or_below(h, v);
+
+    if (frac < 1.0) {
+        fprintf(out, "%12.3f %14.12f %10llu %14.2f\n", v / scale, frac,
+                (unsigned long long)seen, 1.0 / (1.0 - frac));
+    } else {
+        fprintf(out, "%12.3f %14.12f %10llu %14s\n", v / scale, frac,
+                (unsigned long long)seen, "inf");
+    }
+}
+
+// percentile ticks as in HdrHistogram: each halving of the remaining
+// distance to 100% is reported in HIST_TICKS equal steps
+#define HIST_TICKS 5
+
+void hist_print(const struct hist *h, FILE *out, double scale) {
+    fprintf(out, "%12s %14s %10s %14s\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    if (h->total == 0) {
+        return;
+    }
+
+    double remaining = 1.0;  // distance from the current level to 100%
+    while (remaining * h->total >= 1.0) {
+        double base = 1.0 - remaining;
+        for (int t = 0; t < HIST_TICKS; t++) {
+            print_row(h, out, scale, base + remaining / 2 * t / HIST_TICKS);
+        }
+        remaining /= 2;
+    }
+    print_row(h, out, scale, 1.0);
+    fprintf(out, "#[Mean = %.3f, Max = %.3f, Total count = %llu]\n",
+            hist_mean(h) / scale, h->max / scale, (unsigned long long)h->total);
+}
@@ -0,0 +1,36 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// log-linear histogram in the style of HdrHistogram: every power of two is
+// split into HIST_SUB_COUNT / 2 linear sub-buckets, so recorded values keep
+// about 1.6% precision from 1 up to 2^63
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 2) * (HIST_SUB_COUNT / 2))
+
+struct hist {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+};
+
+void hist_init(struct hist *h);
+void hist_record(struct hist *h, uint64_t value);
+void hist_merge(struct hist *dst, const struct hist *src);
+
+// smallest recorded value v such that `pct` percent of samples are <= v
+uint64_t hist_percentile(const struct hist *h, double pct);
+double hist_mean(const struct hist *h);
+
+// one line of the usual percentiles, values divided by `scale`
+void hist_summary(const struct hist *h, FILE *out, const char *label, double scale);
+
+// full percentile distribution in HdrHistogram's text layout
+void hist_print(const struct hist *h, FILE *out, double scale);
+
+#endif // HIST_H
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "linebuf.h"
+#include "scan.h"
+
+void linebuf_init(struct linebuf *lb, char *buf, size_t cap) {
+    lb->buf = buf;
+    lb->cap = cap;
+    lb->start = 0;
+    lb->end = 0;
+}
+
+size_t linebuf_pending(const struct linebuf *lb) {
+    return lb->end - lb->start;
+}
+
+void linebuf_move(struct linebuf *lb, char *buf, size_t cap) {
+    size_t pending = linebuf_pending(lb);
+
+    if (pending > 0) {
+        memmove(buf, lb->buf + lb->start, pending);
+    }
+    lb->buf = buf;
+    lb->cap = cap;
+    lb->start = 0;
+    lb->end = pending;
+}
+
+size_t linebuf_grow_size(const struct linebuf *lb, size_t max) {
+    return lb->cap * 4 < max ? lb->cap * 4 : max;
+}
+
+// make room at the tail: reset when drained, otherwise slide leftovers to the front
+static int make_room(struct linebuf *lb) {
+    if (lb->start == lb->end) {
+        lb->start = lb->end = 0;
+    } else if (lb->end == lb->cap && lb->start > 0) {
+        memmove(lb->buf, lb->buf + lb->start, lb->end - lb->start);
+        lb->end -= lb->start;
+        lb->start = 0;
+    }
+    if (lb->end == lb->cap) {
+        errno = ENOBUFS;  // caller must consume lines before reading more
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t linebuf_fill(struct linebuf *lb, int fd) {
+    ssize_t n;
+
+    if (make_room(lb) < 0) {
+        return -1;
+    }
+    n = recv(fd, lb->buf + lb->end, lb->cap - lb->end, 0);
+    if (n > 0) {
+        lb->end += n;
+    }
+    return n;
+}
+
+ssize_t linebuf_fill_msg(struct linebuf *lb, int fd, void *control, size_t *controllen) {
+    struct iovec iov;
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control,
+                          .msg_controllen = *controllen };
+    ssize_t n;
+
+    if (make_room(lb) < 0) {
+        return -1;
+    }
+    iov.iov_base = lb->buf + lb->end;
+    iov.iov_len = lb->cap - lb->end;
+    n = recvmsg(fd, &msg, 0);
+    if (n > 0) {
+        lb->end += n;
+    }
+    *controllen = n >= 0 ? msg.msg_controllen : 0;
+    return n;
+}
+
+size_t linebuf_line(struct linebuf *lb, size_t maxlen, int eof, const char **line) {
+    size_t avail = lb->end - lb->start;
+    size_t limit = avail < maxlen - 1 ? avail : maxlen - 1;
+    char *p = lb->buf + lb->start;
+    const char *nl = scan_newline(p, limit);  // scan in user space, not one recv() per byte
+    size_t len;
+
+    if (nl != NULL) {
+        len = nl - p + 1;  // line including newline
+    } else if (avail >= maxlen - 1) {
+        len = maxlen - 1;  // line longer than caller's buffer - hand it out in pieces
+    } else if (eof && avail > 0) {
+        len = avail;  // trailing bytes without newline before EOF
+    } else {
+        return 0;  // wait for more data
+    }
+
+    *line = p;
+    lb->start += len;
+    return len;
+}
+
+ssize_t linebuf_readline(struct linebuf *lb, int fd, char *vptr, size_t maxlen) {
+    const char *line;
+    size_t len;
+    int eof = 0;
+
+    while ((len = linebuf_line(lb, maxlen, eof, &line)) == 0 && !eof) {
+        ssize_t rc = linebuf_fill(lb, fd);
+        if (rc == 0) {
+            eof = 1;  // EOF - flush whatever is left as a final line
+        } else if (rc < 0) {
+            if (errno == EINTR) {  // interrupted by signal
+                printf("Server: Read Interrupted - Continuing\n");
+                continue;  // retry read
+            }
+            perror("Server: Read Error");
+            return -1;
+        }
+    }
+
+    if (len > 0) {
+        memcpy(vptr, line, len);
+    }
+    vptr[len] = 0;  // null-terminate string
+    return len;  // return num of bytes, 0 on EOF
+}
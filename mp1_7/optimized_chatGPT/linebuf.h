@@ -0,0 +1,46 @@
+#ifndef LINEBUF_H
+#define LINEBUF_H
+
+#include <sys/types.h>
+
+#define LINEBUF_SIZE 4096  // bytes a single recv() may pull into the buffer
+
+// per-connection receive buffer that hands out complete lines; the memory belongs
+// to the caller (a stack array, or a pooled buffer an event loop hands back when idle)
+struct linebuf {
+    char *buf;
+    size_t cap;
+    size_t start;  // first byte not yet handed out
+    size_t end;    // one past the last received byte
+};
+
+void linebuf_init(struct linebuf *lb, char *buf, size_t cap);
+
+// one recv() into the free space; returns bytes read, 0 on EOF, -1 on error (errno set).
+// ENOBUFS means an unfinished line fills the whole buffer: hand out lines with a
+// smaller maxlen, or move it to a bigger buffer with linebuf_move()
+ssize_t linebuf_fill(struct linebuf *lb, int fd);
+
+// linebuf_fill() through recvmsg(), for ancillary data such as receive timestamps:
+// *controllen is the size of `control` on entry and the bytes filled in on return
+ssize_t linebuf_fill_msg(struct linebuf *lb, int fd, void *control, size_t *controllen);
+
+// hand out the next line (newline included, at most maxlen - 1 bytes) without copying;
+// at EOF the unterminated tail counts as a line. returns its length, or 0 if none is ready
+size_t linebuf_line(struct linebuf *lb, size_t maxlen, int eof, const char **line);
+
+// bytes received but not yet handed out
+size_t linebuf_pending(const struct linebuf *lb);
+
+// switch to another buffer of at least linebuf_pending() bytes, copying the pending
+// bytes over; the old buffer is the caller's to free. Grows a buffer for a long
+// line, or shrinks it back once the line is gone
+void linebuf_move(struct linebuf *lb, char *buf, size_t cap);
+
+// size to grow a full buffer to: 4x (the pool's class step), but no more than `max`
+size_t linebuf_grow_size(const struct linebuf *lb, size_t max);
+
+// blocking readline() replacement: copies one line into vptr and null-terminates it
+ssize_t linebuf_readline(struct linebuf *lb, int fd, char *vptr, size_t maxlen);
+
+#endif // LINEBUF_H
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/uio.h>
+
+#include "server.h"
+#include "log.h"
+#include "stats.h"
+
+#define LOG_RING_SIZE (1 << 16)        // bytes buffered per thread; power of two
+#define LOG_RECORD_MAX 4160            // longest record; longer lines (--max-line) are cut short
+#define LOG_BATCH 16384                // flusher sleeps after a pass that wrote less than this
+#define LOG_IDLE_NS 1000000            // ...for this long, so writes go out in large batches
+
+// single-producer single-consumer byte ring: the owning thread appends, the flusher drains
+struct log_ring {
+    char buf[LOG_RING_SIZE];
+    size_t head;              // bytes ever appended, written by the owner
+    size_t tail;              // bytes ever flushed, written by the flusher
+    unsigned sample_count;    // received lines seen since the last logged one
+    uint64_t written;         // records appended
+    uint64_t sampled_out;     // received lines skipped by sampling
+    uint64_t dropped;         // records lost because the ring was full
+    struct log_ring *next;
+};
+
+static enum log_level log_level = LOG_DEBUG;
+static unsigned log_every = 1;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;  // guards the list, not the rings
+static struct log_ring *rings;
+static __thread struct log_ring *my_ring;
+
+static pthread_t flusher;
+static int running;           // flusher started in this process
+static volatile int stopping;
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static int flusher_idle;      // flusher is sleeping; a filling ring may cut that short
+
+void log_configure(enum log_level level, unsigned sample) {
+    log_level = level;
+    log_every = sample ? sample : 1;
+}
+
+// this thread's ring, created on first use
+static struct log_ring *ring_get(void) {
+    if (my_ring == NULL) {
+        my_ring = calloc(1, sizeof(*my_ring));
+        if (my_ring == NULL) {
+            return NULL;
+        }
+        pthread_mutex_lock(&rings_lock);
+        my_ring->next = rings;
+        rings = my_ring;
+        pthread_mutex_unlock(&rings_lock);
+    }
+    return my_ring;
+}
+
+int log_sample(void) {
+    if (log_level < LOG_DEBUG) {
+        return 0;
+    }
+    if (log_every == 1) {
+        return 1;
+    }
+    struct log_ring *r = running ? ring_get() : NULL;
+    static __thread unsigned count;  // used before the flusher exists
+    unsigned *c = r ? &r->sample_count : &count;
+
+    if ((*c)++ % log_every != 0) {  // keeps the 1st, (N+1)th, ... line
+        if (r != NULL) {
+            r->sampled_out++;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+void log_write(enum log_level level, const char *fmt, ...) {
+    char rec[LOG_RECORD_MAX];
+    va_list ap;
+
+    if (level > log_level) {
+        return;
+    }
+    va_start(ap, fmt);
+    int n = vsnprintf(rec, sizeof(rec), fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n >= sizeof(rec)) {
+        // truncated: mark it and keep the newline, or the next record runs onto this line
+        static const char cut[] = "...\n";
+        n = sizeof(rec) - 1;
+        memcpy(rec + n - (sizeof(cut) - 1), cut, sizeof(cut) - 1);
+    }
+
+    struct log_ring *r = running ? ring_get() : NULL;
+    if (r == NULL) {
+        fwrite(rec, 1, n, stdout);  // no flusher in this process
+        return;
+    }
+
+    size_t head = r->head;
+    size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (LOG_RING_SIZE - (head - tail) < (size_t)n) {
+        r->dropped++;  // never block the echo path on logging
+        return;
+    }
+    size_t off = head & (LOG_RING_SIZE - 1);
+    size_t first = LOG_RING_SIZE - off < (size_t)n ? LOG_RING_SIZE - off : (size_t)n;
+    memcpy(r->buf + off, rec, first);
+    memcpy(r->buf, rec + first, n - first);
+    r->written++;
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+
+    // past half full: wake the flusher now rather than drop records before its timer fires
+    if (head + n - tail > LOG_RING_SIZE / 2 && __atomic_load_n(&flusher_idle, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&wake_lock);
+        flusher_idle = 0;
+        pthread_cond_signal(&wake_cond);
+        pthread_mutex_unlock(&wake_lock);
+    }
+}
+
+// write out everything buffered in one ring; returns bytes written
+static size_t ring_drain(struct log_ring *r) {
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    size_t tail = r->tail;
+    size_t total = 0;
+
+    while (tail != head) {
+        size_t off = tail & (LOG_RING_SIZE - 1);
+        size_t len = head - tail;
+        struct iovec iov[2];
+        int cnt = 1;
+
+        iov[0].iov_base = r->buf + off;
+        iov[0].iov_len = len;
+        if (off + len > LOG_RING_SIZE) {  // wrapped: second piece starts at buf[0]
+            iov[0].iov_len = LOG_RING_SIZE - off;
+            iov[1].iov_base = r->buf;
+            iov[1].iov_len = len - iov[0].iov_len;
+            cnt = 2;
+        }
+        ssize_t n = writev(STDOUT_FILENO, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tail = head;  // stdout is gone - discard rather than spin
+            break;
+        }
+        tail += n;
+        total += n;
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    return total;
+}
+
+static size_t drain_all(void) {
+    size_t total = 0;
+
+    pthread_mutex_lock(&rings_lock);
+    for (struct log_ring *r = rings; r != NULL; r = r->next) {
+        total += ring_drain(r);
+    }
+    pthread_mutex_unlock(&rings_lock);
+    return total;
+}
+
+static void *flusher_thread(void *arg) {
+    while (!stopping) {
+        if (drain_all() < LOG_BATCH) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += LOG_IDLE_NS;
+            if (until.tv_nsec >= 1000000000) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_mutex_lock(&wake_lock);
+            __atomic_store_n(&flusher_idle, 1, __ATOMIC_RELAXED);
+            pthread_cond_timedwait(&wake_cond, &wake_lock, &until);
+            flusher_idle = 0;
+            pthread_mutex_unlock(&wake_lock);
+        }
+    }
+    drain_all();
+    return NULL;
+}
+
+// SIGUSR1 section: records written, sampled out and dropped across all threads
+static void log_dump(FILE *out) {
+    uint64_t written = 0, sampled_out = 0, dropped = 0;
+
+    pthread_mutex_lock(&rings_lock);
+    for (struct log_ring *r = rings; r != NULL; r = r->next) {
+        written += r->written;
+        sampled_out += r->sampled_out;
+        dropped += r->dropped;
+    }
+    pthread_mutex_unlock(&rings_lock);
+    fprintf(out, "Server Log: %llu records  %llu lines sampled out  %llu dropped (ring full)\n",
+            (unsigned long long)written, (unsigned long long)sampled_out,
+            (unsigned long long)dropped);
+}
+
+void log_start(void) {
+    if (running) {
+        return;
+    }
+    fflush(stdout);  // earlier stdio output goes first
+    stopping = 0;
+    // SIGUSR1 must interrupt a serving thread, which then dumps - never the flusher
+    sigset_t usr1, old;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, &old);
+    int rc = pthread_create(&flusher, NULL, flusher_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        perror("Server: pthread_create");
+        return;  // keep logging synchronously
+    }
+    running = 1;
+    stats_add_section(log_dump);
+}
+
+void log_stop(void) {
+    if (!running) {
+        fflush(stdout);
+        return;
+    }
+    stopping = 1;
+    pthread_join(flusher, NULL);
+    running = 0;
+}
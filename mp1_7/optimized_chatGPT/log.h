@@ -0,0 +1,29 @@
+#ifndef LOG_H
+#define LOG_H
+
+// server log: records go into a lock-free ring owned by the calling thread and a
+// background flusher thread writes them to stdout, so the echo path never blocks
+// on the stdio lock or on a slow terminal/file
+
+enum log_level {
+    LOG_ERROR,  // failures only
+    LOG_INFO,   // connection and worker lifecycle
+    LOG_DEBUG,  // every received line ("Server Received: ...")
+};
+
+// set the level and keep 1 in `sample` received lines; call before log_start()
+void log_configure(enum log_level level, unsigned sample);
+
+// nonzero if this thread's next received line should be logged (applies level and sampling)
+int log_sample(void);
+
+// format one record; written straight to stdout until log_start() has run in this process
+void log_write(enum log_level level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// start the flusher thread; call again in each forked child that logs
+void log_start(void);
+
+// stop the flusher and write out whatever is still buffered (before exit)
+void log_stop(void);
+
+#endif // LOG_H
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "stats.h"
+#include "affinity.h"
+
+#define SLAB_MIN 65536      // smallest slab; grown until it holds SLAB_OBJS objects
+#define SLAB_OBJS 8
+#define SLAB_HDR 64         // header space before the first object (one cache line)
+#define OBJ_ALIGN 16
+#define SPARE_BYTES 262144  // empty slabs a pool always keeps (at least one slab)
+
+// header at the start of every slab
+struct slab {
+    struct slab *prev, *next;  // partial list links
+    void *free;                // objects given back, linked through their first word
+    size_t used;               // objects handed out
+    size_t carved;             // objects ever cut off the untouched tail
+};
+
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct slab_pool *pools;
+
+static void dump_pools(FILE *out) {
+    pthread_mutex_lock(&pools_lock);
+    for (const struct slab_pool *p = pools; p != NULL; p = p->next) {
+        if (p->slabs == 0 && p->slabs_freed == 0) {
+            continue;  // never used (e.g. a buffer class no connection needed)
+        }
+        uint64_t capacity = p->slabs * p->per_slab;
+        fprintf(out, "Server Pool: %-10s %-8s in use %llu/%llu (%.0f%%)  peak %llu"
+                     "  slabs %llu x %zu KB  slabs freed %llu\n", p->owner, p->name,
+                (unsigned long long)p->in_use, (unsigned long long)capacity,
+                capacity ? 100.0 * p->in_use / capacity : 0.0, (unsigned long long)p->peak,
+                (unsigned long long)p->slabs, p->slab_bytes / 1024,
+                (unsigned long long)p->slabs_freed);
+    }
+    pthread_mutex_unlock(&pools_lock);
+}
+
+void slab_init(struct slab_pool *p, const char *owner, const char *name, size_t obj_size) {
+    static int registered;
+
+    memset(p, 0, sizeof(*p));
+    p->owner = owner;
+    p->name = name;
+    p->obj_size = (obj_size + OBJ_ALIGN - 1) & ~(size_t)(OBJ_ALIGN - 1);
+    p->slab_bytes = SLAB_MIN;
+    while ((p->slab_bytes - SLAB_HDR) / p->obj_size < SLAB_OBJS) {
+        p->slab_bytes *= 2;
+    }
+    p->per_slab = (p->slab_bytes - SLAB_HDR) / p->obj_size;
+
+    pthread_mutex_lock(&pools_lock);
+    p->next = pools;
+    pools = p;
+    if (!registered) {
+        registered = 1;
+        stats_add_section(dump_pools);
+    }
+    pthread_mutex_unlock(&pools_lock);
+}
+
+static void partial_push(struct slab_pool *p, struct slab *s) {
+    s->prev = NULL;
+    s->next = p->partial;
+    if (p->partial != NULL) {
+        p->partial->prev = s;
+    }
+    p->partial = s;
+}
+
+static void partial_unlink(struct slab_pool *p, struct slab *s) {
+    if (s->prev != NULL) {
+        s->prev->next = s->next;
+    } else {
+        p->partial = s->next;
+    }
+    if (s->next != NULL) {
+        s->next->prev = s->prev;
+    }
+}
+
+// a fresh slab is only reserved; its pages are touched as objects are carved off
+static struct slab *slab_new(struct slab_pool *p) {
+    void *mem;
+    int rc = posix_memalign(&mem, p->slab_bytes, p->slab_bytes);
+
+    if (rc != 0) {
+        errno = rc;  // for the caller's perror()
+        return NULL;
+    }
+    if (placement_node() >= 0) {
+        numa_bind(mem, p->slab_bytes, placement_node());  // before the header touches it
+    }
+    struct slab *s = mem;
+    s->free = NULL;
+    s->used = s->carved = 0;
+    p->slabs++;
+    return s;
+}
+
+void *slab_alloc(struct slab_pool *p) {
+    struct slab *s = p->partial;
+    void *obj;
+
+    if (s == NULL) {
+        if (p->spare != NULL) {
+            s = p->spare;
+            p->spare = s->next;
+            p->spares--;
+        } else if ((s = slab_new(p)) == NULL) {
+            return NULL;
+        }
+        partial_push(p, s);
+    }
+    if (s->free != NULL) {
+        obj = s->free;
+        s->free = *(void **)obj;
+    } else {
+        obj = (char *)s + SLAB_HDR + s->carved++ * p->obj_size;
+    }
+    if (++s->used == p->per_slab) {
+        partial_unlink(p, s);  // full slabs are found again through their objects
+    }
+    if (++p->in_use > p->peak) {
+        p->peak = p->in_use;
+    }
+    return obj;
+}
+
+// give spares beyond SPARE_BYTES (but never the last one) back to the system
+static void trim_spares(struct slab_pool *p) {
+    while (p->spares > 1 && p->spares * p->slab_bytes > SPARE_BYTES) {
+        struct slab *s = p->spare;
+        p->spare = s->next;
+        p->spares--;
+        free(s);
+        p->slabs--;
+        p->slabs_freed++;
+    }
+}
+
+void slab_free(struct slab_pool *p, void *obj) {
+    struct slab *s = (struct slab *)((uintptr_t)obj & ~(uintptr_t)(p->slab_bytes - 1));
+
+    *(void **)obj = s->free;
+    s->free = obj;
+    if (s->used-- == p->per_slab) {
+        partial_push(p, s);
+    }
+    p->in_use--;
+    if (s->used > 0) {
+        return;
+    }
+    // keep empty slabs up to SPARE_BYTES, or while in use is at least their room,
+    // so a pool that swings across slab boundaries does not go back to malloc()
+    partial_unlink(p, s);
+    if (p->spares == 0 || (p->spares + 1) * p->slab_bytes <= SPARE_BYTES ||
+        p->spares * p->per_slab <= p->in_use) {
+        s->next = p->spare;
+        p->spare = s;
+        p->spares++;
+    } else {
+        free(s);
+        p->slabs--;
+        p->slabs_freed++;
+    }
+    if (p->in_use == 0) {
+        trim_spares(p);  // the storm is over
+    }
+}
+
+static const char *buf_names[BUF_CLASSES] = { "buf 4K", "buf 16K", "buf 64K" };
+
+void buf_pool_init(struct buf_pool *bp, const char *owner) {
+    for (int i = 0; i < BUF_CLASSES; i++) {
+        slab_init(&bp->cls[i], owner, buf_names[i], (size_t)BUF_MIN << 2 * i);
+    }
+}
+
+// size classes grow by 4x: class i holds BUF_MIN << 2i bytes
+static int buf_class(size_t size) {
+    int i = 0;
+    while (i < BUF_CLASSES - 1 && ((size_t)BUF_MIN << 2 * i) < size) {
+        i++;
+    }
+    return i;
+}
+
+char *buf_get(struct buf_pool *bp, size_t want, size_t *cap) {
+    if (want > BUF_MAX) {
+        *cap = want;
+        return malloc(want);
+    }
+    int i = buf_class(want);
+    *cap = (size_t)BUF_MIN << 2 * i;
+    return slab_alloc(&bp->cls[i]);
+}
+
+void buf_put(struct buf_pool *bp, char *buf, size_t cap) {
+    if (cap > BUF_MAX) {
+        free(buf);
+        return;
+    }
+    slab_free(&bp->cls[buf_class(cap)], buf);
+}
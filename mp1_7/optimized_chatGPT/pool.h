@@ -0,0 +1,55 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// fixed-size object allocator for per-connection state. Objects are cut from
+// large aligned slabs and recycled through per-slab free lists, so connection
+// storms do not churn malloc(). Emptied slabs are kept as spares up to 256 KB,
+// or while the spare room stays within what is in use; past that they go back to
+// the system, so a pool shrinks after a storm. Pools are not thread-safe: each
+// event loop owns its own, the way it owns its connections.
+
+struct slab;
+
+struct slab_pool {
+    const char *owner;     // label in the dump, e.g. "reactor 0"
+    const char *name;      // what it holds, e.g. "conn"
+    size_t obj_size;
+    size_t slab_bytes;     // power of two, so an object finds its slab by masking
+    size_t per_slab;       // objects that fit in one slab
+    struct slab *partial;  // slabs with free objects
+    struct slab *spare;    // empty slabs held back for the next storm
+    uint64_t spares;
+    uint64_t in_use;       // objects handed out
+    uint64_t peak;         // most objects handed out at once
+    uint64_t slabs;        // slabs allocated now, spares included
+    uint64_t slabs_freed;  // empty slabs given back to the system
+    struct slab_pool *next;
+};
+
+// set up a pool and make it visible in the SIGUSR1 dump
+void slab_init(struct slab_pool *p, const char *owner, const char *name, size_t obj_size);
+void *slab_alloc(struct slab_pool *p);  // NULL when out of memory; contents undefined
+void slab_free(struct slab_pool *p, void *obj);
+
+// receive buffers in size classes from LINEBUF_SIZE, where every connection starts: 4 KB,
+// 16 KB, 64 KB
+#define BUF_CLASSES 3
+#define BUF_MIN 4096
+#define BUF_MAX (BUF_MIN << 2 * (BUF_CLASSES - 1))
+
+struct buf_pool {
+    struct slab_pool cls[BUF_CLASSES];
+};
+
+void buf_pool_init(struct buf_pool *bp, const char *owner);
+
+// a buffer of the smallest class holding `want` bytes; its real size is stored in
+// *cap. Beyond BUF_MAX (a --max-line past 64 KB) it comes from malloc() at exactly
+// `want` bytes - rare enough that pooling it would only hold memory
+char *buf_get(struct buf_pool *bp, size_t want, size_t *cap);
+void buf_put(struct buf_pool *bp, char *buf, size_t cap);
+
+#endif // POOL_H
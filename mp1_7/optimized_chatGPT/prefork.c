@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "server.h"
+#include "stats.h"
+#include "log.h"
+#include "affinity.h"
+
+#define RESPAWN_DELAY 1  // seconds to wait before replacing a worker that died right after starting
+
+static volatile sig_atomic_t stopping;      // set by SIGINT/SIGTERM in the supervisor
+static volatile sig_atomic_t forward_usr1;  // SIGUSR1 to pass on to every worker
+
+static void stop_handler(int signo) {
+    stopping = 1;
+}
+
+static void usr1_handler(int signo) {
+    forward_usr1 = 1;
+}
+
+// fork one worker: it opens its own SO_REUSEPORT listener, shares the supervisor's
+// --unix listener (unixfd, -1 without one) and runs the event loop
+static pid_t spawn_worker(const struct server_config *cfg, int id, int unixfd) {
+    fflush(stdout);  // keep workers from repeating buffered output
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Server: Fork Failed");
+        return -1;
+    }
+    if (pid == 0) {  // worker process
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        stats_install_signal(1);
+        log_start();
+        placement_apply(id);  // the worker's loop, not its log flusher
+        struct listeners ls = { .n = 0 };
+        if (cfg->port >= 0) {
+            ls.fd[ls.n++] = create_listener(cfg);
+        }
+        if (unixfd >= 0) {
+            ls.fd[ls.n++] = unixfd;
+        }
+        run_epoll_server(&ls, cfg);
+        exit(0);
+    }
+    printf("Server: Worker %d Started (pid %d)\n", id, (int)pid);
+    return pid;
+}
+
+// start cfg->workers workers up front and respawn any that die
+void run_prefork_server(const struct server_config *cfg) {
+    pid_t *pids = calloc(cfg->workers, sizeof(*pids));
+    time_t *started = calloc(cfg->workers, sizeof(*started));
+    if (pids == NULL || started == NULL) {
+        perror("Server: Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+
+    // fail fast on a bad port instead of respawning workers that cannot bind
+    if (cfg->port >= 0) {
+        close(create_listener(cfg));
+    }
+    // a path can only be bound once, so every worker accepts from the same Unix listener
+    int unixfd = cfg->unix_path != NULL ? create_unix_listener(cfg) : -1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;  // no SA_RESTART so waitpid() returns on shutdown
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = usr1_handler;  // each worker prints its own counters
+    sigaction(SIGUSR1, &sa, NULL);
+
+    char where[160];
+    describe_listeners(cfg, where, sizeof(where));
+    printf("Server: Listening on %s (prefork mode, %d workers%s)\n", where, cfg->workers,
+           cfg->low_latency ? ", low latency" : "");
+    for (int i = 0; i < cfg->workers; i++) {
+        pids[i] = spawn_worker(cfg, i, unixfd);
+        started[i] = time(NULL);
+    }
+
+    // supervisor loop: reap dead workers and start replacements
+    while (!stopping) {
+        int status, missing = 0;
+        for (int i = 0; i < cfg->workers; i++) {
+            missing |= pids[i] < 0;
+        }
+        // a slot whose fork failed must not wait for some other worker to die
+        pid_t pid = waitpid(-1, &status, missing ? WNOHANG : 0);
+        if (pid == 0) {
+            sleep(RESPAWN_DELAY);  // nothing exited - retry the failed forks shortly
+        }
+        if (forward_usr1) {
+            forward_usr1 = 0;
+            for (int i = 0; i < cfg->workers; i++) {
+                if (pids[i] > 0) {
+                    kill(pids[i], SIGUSR1);
+                }
+            }
+        }
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ECHILD) {
+                sleep(RESPAWN_DELAY);  // every fork failed - try again shortly
+            } else {
+                perror("Server: waitpid");
+            }
+        }
+
+        for (int i = 0; i < cfg->workers && !stopping; i++) {
+            int exited = pid > 0 && pids[i] == pid;  // pid is -1 when waitpid() failed
+            if (exited || pids[i] < 0) {
+                if (exited) {
+                    if (WIFSIGNALED(status)) {
+                        printf("Server: Worker %d (pid %d) Killed by Signal %d - Respawning\n",
+                               i, (int)pid, WTERMSIG(status));
+                    } else {
+                        printf("Server: Worker %d (pid %d) Exited with Status %d - Respawning\n",
+                               i, (int)pid, WEXITSTATUS(status));
+                    }
+                }
+                if (time(NULL) - started[i] < RESPAWN_DELAY) {
+                    sleep(RESPAWN_DELAY);  // avoid a tight crash/respawn loop
+                }
+                pids[i] = spawn_worker(cfg, i, unixfd);
+                started[i] = time(NULL);
+            }
+        }
+    }
+
+    // shut down: stop every worker and wait for them
+    for (int i = 0; i < cfg->workers; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR);
+
+    if (unixfd >= 0) {
+        close(unixfd);
+        unlink(cfg->unix_path);
+    }
+    printf("Server: Workers Stopped\n");
+    free(pids);
+    free(started);
+}
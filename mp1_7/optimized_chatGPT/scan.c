@@ -0,0 +1,156 @@
+#include <stdint.h>
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// plain byte loop: the fallback, and the tail of the SIMD versions
+static const char *scan_newline_byte(const char *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] == '\n') {
+            return p + i;
+        }
+    }
+    return NULL;
+}
+
+#ifdef SCAN_X86
+// Both SIMD versions check one unaligned vector at p, continue with aligned loads from the
+// next boundary (no cache-line splits), and finish with one unaligned vector ending exactly
+// at p + len. Bytes covered twice are already known to hold no newline, so the overlap is
+// harmless, and nothing outside [p, p + len) is ever read.
+
+__attribute__((target("sse2")))
+static const char *scan_newline_sse2(const char *p, size_t len) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    unsigned mask;
+
+    if (len < 16) {
+        return scan_newline_byte(p, len);
+    }
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), nl));
+    if (mask != 0) {
+        return p + __builtin_ctz(mask);
+    }
+
+    size_t i = 16 - ((uintptr_t)p & 15);
+    for (; i + 16 <= len; i += 16) {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)(p + i)), nl));
+        if (mask != 0) {
+            return p + i + __builtin_ctz(mask);
+        }
+    }
+    if (i < len) {
+        i = len - 16;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), nl));
+        if (mask != 0) {
+            return p + i + __builtin_ctz(mask);
+        }
+    }
+    return NULL;
+}
+
+// same shape with 32-byte vectors, four per iteration in the aligned loop
+__attribute__((target("avx2")))
+static const char *scan_newline_avx2(const char *p, size_t len) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    unsigned mask;
+
+    if (len < 32) {
+        return scan_newline_sse2(p, len);
+    }
+    mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), nl));
+    if (mask != 0) {
+        return p + __builtin_ctz(mask);
+    }
+
+    size_t i = 32 - ((uintptr_t)p & 31);
+    for (; i + 128 <= len; i += 128) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)(p + i)), nl);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)(p + i + 32)), nl);
+        __m256i c = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)(p + i + 64)), nl);
+        __m256i d = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)(p + i + 96)), nl);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any)) {
+            uint64_t lo = (uint32_t)_mm256_movemask_epi8(a) |
+                          (uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32;
+            if (lo != 0) {
+                return p + i + __builtin_ctzll(lo);
+            }
+            uint64_t hi = (uint32_t)_mm256_movemask_epi8(c) |
+                          (uint64_t)(uint32_t)_mm256_movemask_epi8(d) << 32;
+            return p + i + 64 + __builtin_ctzll(hi);
+        }
+    }
+    for (; i + 32 <= len; i += 32) {
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)(p + i)), nl));
+        if (mask != 0) {
+            return p + i + __builtin_ctz(mask);
+        }
+    }
+    if (i < len) {
+        i = len - 32;
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), nl));
+        if (mask != 0) {
+            return p + i + __builtin_ctz(mask);
+        }
+    }
+    return NULL;
+}
+#endif
+
+const scan_fn scan_byte = scan_newline_byte;
+
+scan_fn scan_sse2_fn(void) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") ? scan_newline_sse2 : NULL;
+#else
+    return NULL;
+#endif
+}
+
+scan_fn scan_avx2_fn(void) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? scan_newline_avx2 : NULL;
+#else
+    return NULL;
+#endif
+}
+
+static const char *scan_newline_resolve(const char *p, size_t len);
+
+// dispatch target, filled in on the first call; every thread stores the same value
+static scan_fn scan_selected = scan_newline_resolve;
+static const char *scan_name = "byte";
+
+static const char *scan_newline_resolve(const char *p, size_t len) {
+    scan_fn fn = scan_newline_byte;
+    const char *name = "byte";
+
+    if (scan_avx2_fn() != NULL) {
+        fn = scan_avx2_fn();
+        name = "avx2";
+    } else if (scan_sse2_fn() != NULL) {
+        fn = scan_sse2_fn();
+        name = "sse2";
+    }
+    scan_name = name;
+    __atomic_store_n(&scan_selected, fn, __ATOMIC_RELAXED);
+    return fn(p, len);
+}
+
+const char *scan_newline(const char *p, size_t len) {
+    return __atomic_load_n(&scan_selected, __ATOMIC_RELAXED)(p, len);
+}
+
+const char *scan_impl(void) {
+    if (scan_selected == scan_newline_resolve) {
+        scan_newline("", 0);  // resolve now
+    }
+    return scan_name;
+}
@@ -0,0 +1,18 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// first '\n' in p[0, len), or NULL; picks the widest SIMD version the CPU supports
+const char *scan_newline(const char *p, size_t len);
+
+// name of the version scan_newline() dispatches to ("avx2", "sse2" or "byte")
+const char *scan_impl(void);
+
+// individual versions, for bench_scan; the SIMD ones are NULL where unsupported
+typedef const char *(*scan_fn)(const char *p, size_t len);
+extern const scan_fn scan_byte;
+scan_fn scan_sse2_fn(void);
+scan_fn scan_avx2_fn(void);
+
+#endif // SCAN_H
@@ -3,12 +3,26 @@
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <signal.h>    
+#include <poll.h>
+#include <fcntl.h>
 #include <sys/wait.h> 
 
-#define MAXLINE 1024  // maximum buffer size
+#include "server.h"
+#include "linebuf.h"
+#include "stats.h"
+#include "log.h"
+#include "accept.h"
+#include "scan.h"
+#include "affinity.h"
+#include "tstamp.h"
+#include "pool.h"
+#include "coro.h"
 
 // function to write 'n' bytes to socket
 int writen(int fd, const char *vptr, size_t n) {
@@ -33,52 +47,154 @@ int writen(int fd, const char *vptr, size_t n) {
     return n;  // if transmitting message is successful, return num of bytes sent
 }
 
-// function to read line from socket
-ssize_t readline(int fd, char *vptr, size_t maxlen) {
-    ssize_t n, rc;
-    char c, *ptr = vptr;  // pointer to buffer
+// log every complete line buffered in lb and return them as one contiguous span;
+// lines handed out back to back sit next to each other in the buffer, so a
+// single send() echoes the whole batch
+size_t collect_lines(struct linebuf *lb, size_t max_line, int eof, const char **span,
+                     struct echo_stats *st) {
+    const char *line;
+    size_t len, total = 0;
 
-    // loop to read up to maxlen characters or until newline
-    for (n = 1; n < maxlen; n++) {
-        if ((rc = recv(fd, &c, 1, 0)) == 1) {  // read one byte from socket
-            *ptr++ = c;  // store character in buffer
-            if (c == '\n') {  // newline encountered
-                *ptr = 0;  // null-terminate string
-                return n;  // return num of bytes read
-            }
-        } else if (rc == 0) {  // EOF
-            *ptr = 0;  // null-terminate string
-            return n - 1;  // return bytes read before EOF
-        } else {
-            if (errno == EINTR) {  // interrupted by signal
-                printf("Server: Read Interrupted - Continuing\n");
-                continue;  // retry read
-            }
-            perror("Server: Read Error");  
-            return -1;  
+    while ((len = linebuf_line(lb, max_line + 1, eof, &line)) > 0) {
+        if (log_sample()) {
+            log_write(LOG_DEBUG, "Server Received: %.*s", (int)len, line);
+        }
+        if (total == 0) {
+            *span = line;
         }
+        total += len;
+        st->lines++;
     }
+    st->bytes += total;
+    return total;
+}
+
+// log and count the lines in received bytes that are echoed as they arrived rather than
+// line by line (uring buffers, --zerocopy chunks); *line_start and *line_logged carry
+// a line that continues into the next piece
+void log_stream(const char *p, size_t len, int *line_start, int *line_logged, struct echo_stats *st) {
+    st->bytes += len;
+    while (len > 0) {
+        const char *nl = scan_newline(p, len);
+        size_t n = nl ? (size_t)(nl - p + 1) : len;
 
-    *ptr = 0;  // null-terminate string
-    return n;  // return num of bytes
+        st->lines += nl != NULL;
+        if (*line_start) {
+            *line_logged = log_sample();
+        }
+        if (*line_logged) {
+            log_write(LOG_DEBUG, "%s%.*s", *line_start ? "Server Received: " : "", (int)n, p);
+        }
+        *line_start = nl != NULL;
+        p += n;
+        len -= n;
+    }
+}
+
+static int idle_timeout;  // fork mode: --idle-timeout, applied as socket timeouts per child
+static int low_latency;   // fork mode: re-arm TCP_QUICKACK after every read
+static struct tstamp_hists *timestamps;  // fork mode: --timestamps on this child's connection
+static size_t max_line = MAXLINE;        // fork mode: --max-line
+
+// grow the receive buffer for a line that fills it; a grown buffer is always on the heap
+static int grow_input(struct linebuf *lb, const char *small, struct echo_stats *st) {
+    size_t cap = linebuf_grow_size(lb, max_line);
+    char *buf = malloc(cap);
+
+    if (buf == NULL) {
+        perror("Server: Out of Memory");
+        return -1;
+    }
+    char *old = lb->buf;
+    linebuf_move(lb, buf, cap);
+    if (old != small) {
+        free(old);
+    }
+    st->buf_grows++;
+    if (cap > st->buf_peak) {
+        st->buf_peak = cap;
+    }
+    return 0;
 }
 
 // function to echo back received data to client
 void response(int sockfd) {
-    char buf[MAXLINE];  // buffer to hold received data
-    int n;
+    char buf[LINEBUF_SIZE];  // enough for the usual short lines; longer ones move to the heap
+    struct linebuf lb;  // buffered reader - one recv() per chunk instead of per byte
+    struct echo_stats st;
+    struct tstamp_conn tc;
+    char control[TSTAMP_CONTROL];
+    size_t controllen;
+    const char *span;
+    size_t len;
+    ssize_t n;
+    int eof = 0;
+
+    linebuf_init(&lb, buf, sizeof(buf));
+    memset(&st, 0, sizeof(st));
+    stats_register(&st, "connection");
+    tstamp_conn_init(&tc);
 
     // loop to continuously read data from client
-    while ((n = readline(sockfd, buf, MAXLINE)) > 0) {
-        printf("Server Received: %s", buf);  
-        if (writen(sockfd, buf, n) != n) {  // echo data back to client
-            perror("Server: Write Back Error");  
+    while (!eof) {
+        controllen = sizeof(control);
+        n = timestamps ? linebuf_fill_msg(&lb, sockfd, control, &controllen) : linebuf_fill(&lb, sockfd);
+        if (n < 0) {
+            if (errno == EINTR) {  // interrupted by signal
+                if (stats_dump_requested()) {
+                    if (timestamps) {
+                        tstamp_reap(sockfd, &tc, timestamps);  // the last echo's transmit stamp
+                    }
+                    stats_dump(stdout);  // SIGUSR1 on an idle connection
+                } else {
+                    printf("Server: Read Interrupted - Continuing\n");
+                }
+                continue;  // retry read
+            }
+            if (errno == ENOBUFS && grow_input(&lb, buf, &st) == 0) {
+                continue;  // a line longer than the buffer - read the rest of it
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {  // SO_RCVTIMEO from --idle-timeout
+                log_write(LOG_INFO, "Server: Closing Connection Idle for %d s\n", idle_timeout);
+                st.idle_closed++;
+                break;
+            }
+            perror("Server: Failed to Read - Retrying.");
+            break;
+        }
+        st.recv_calls++;
+        eof = n == 0;
+        if (low_latency) {
+            rearm_quickack(sockfd);
+        }
+        if (timestamps) {
+            tstamp_received(&tc, control, controllen, timestamps);
         }
-    }
 
-    // check for errors in final read operation
-    if (n < 0) {
-        perror("Server: Failed to Read - Retrying.");
+        // echo every line that arrived with this read in one write
+        if ((len = collect_lines(&lb, max_line, eof, &span, &st)) > 0) {
+            uint64_t sent_at = timestamps ? tstamp_now() : 0;
+            st.send_calls++;
+            if (writen(sockfd, span, len) != (int)len) {  // echo data back to client
+                perror("Server: Write Back Error");
+            } else if (timestamps) {
+                tstamp_sent(&tc, len, sent_at, timestamps);
+            }
+        }
+        if (timestamps) {
+            tstamp_reap(sockfd, &tc, timestamps);  // stamps of this echo, or of the one before
+        }
+        if (lb.buf != buf && linebuf_pending(&lb) <= sizeof(buf)) {
+            char *big = lb.buf;  // the long line is out - back to the stack buffer
+            linebuf_move(&lb, buf, sizeof(buf));
+            free(big);
+        }
+        if (stats_dump_requested()) {
+            stats_dump(stdout);
+        }
+    }
+    if (lb.buf != buf) {
+        free(lb.buf);
     }
 }
 
@@ -87,41 +203,279 @@ void sigchld_handler(int signo) {
     while (waitpid(-1, NULL, WNOHANG) > 0);
 }
 
-int main(int argc, char **argv) {
+// --mode= names, indexed by enum server_mode
+static const char *const mode_names[] = {
+    [MODE_FORK] = "fork",
+    [MODE_EPOLL] = "epoll",
+    [MODE_PREFORK] = "prefork",
+    [MODE_URING] = "uring",
+    [MODE_REACTOR] = "reactor",
+    [MODE_UDP] = "udp",
+    [MODE_CORO] = "coro",
+};
 
-    // signal handler for SIGCHLD for zombie processes
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART;
-    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
-        perror("Server: SIGACTION");
-        exit(EXIT_FAILURE);
-    }
+// --log-level= names, indexed by enum log_level
+static const char *const level_names[] = {
+    [LOG_ERROR] = "error",
+    [LOG_INFO] = "info",
+    [LOG_DEBUG] = "debug",
+};
 
-    if (argc != 2) {  // check if user provided port number as an argument
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
-        exit(EXIT_FAILURE);
+// print command-line usage and exit
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--mode=fork|epoll|prefork|uring|reactor|udp|coro] [--workers=N]\n"
+                    "       [--backlog=N] [--threads=N] [--balance=rr|least] [--splice] [--batch=N]\n"
+                    "       [--high-water=BYTES] [--low-water=BYTES]\n"
+                    "       [--log-level=error|info|debug] [--log-sample=N]\n"
+                    "       [--idle-timeout=SECONDS] [--low-latency] [--busy-poll=USEC]\n"
+                    "       [--spin=USEC] [--zerocopy[=BYTES]] [--unix=PATH]\n"
+                    "       [--cpus=LIST | --irq-affinity=IFACE] [--numa] [--timestamps]\n"
+                    "       [--max-line=BYTES] [--stack-size=BYTES] <port>\n"
+                    "       (the port may be left out when --unix is given)\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+// parse command-line options into cfg
+static void parse_args(int argc, char **argv, struct server_config *cfg) {
+    const char *port_arg = NULL;
+
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->mode = MODE_FORK;  // default keeps the original fork-per-connection design
+    cfg->workers = sysconf(_SC_NPROCESSORS_ONLN);  // prefork: one worker per core
+    cfg->threads = cfg->workers;                   // reactor: one thread per core
+    cfg->backlog = SOMAXCONN;  // the kernel clamps this to net.core.somaxconn
+    cfg->batch = 32;
+    cfg->high_water = 64 * 1024;
+    cfg->low_water = 16 * 1024;
+    cfg->log_level = LOG_DEBUG;  // log every received line, like the original server
+    cfg->log_sample = 1;
+    cfg->busy_poll = 50;  // --low-latency only
+    cfg->max_line = BUF_MAX;  // a 64 KB line still fits one pooled receive buffer
+    cfg->stack_size = CORO_STACK_DEFAULT;
+    cfg->spin_us = cfg->workers > 1 ? 50 : 0;  // spinning on the only core starves the peer
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--mode=", 7) == 0) {
+            const char *mode = argv[i] + 7;
+            size_t m;
+            for (m = 0; m < sizeof(mode_names) / sizeof(mode_names[0]); m++) {
+                if (strcmp(mode, mode_names[m]) == 0) {
+                    break;
+                }
+            }
+            if (m == sizeof(mode_names) / sizeof(mode_names[0])) {
+                fprintf(stderr, "Server: Unknown Mode '%s'\n", mode);
+                usage(argv[0]);
+            }
+            cfg->mode = m;
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            cfg->workers = atoi(argv[i] + 10);
+            if (cfg->workers < 1) {
+                fprintf(stderr, "Server: Worker Count Must Be Positive\n");
+                usage(argv[0]);
+            }
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            cfg->threads = atoi(argv[i] + 10);
+            if (cfg->threads < 1) {
+                fprintf(stderr, "Server: Thread Count Must Be Positive\n");
+                usage(argv[0]);
+            }
+        } else if (strncmp(argv[i], "--backlog=", 10) == 0) {
+            cfg->backlog = atoi(argv[i] + 10);
+            if (cfg->backlog < 1) {
+                fprintf(stderr, "Server: Backlog Must Be Positive\n");
+                usage(argv[0]);
+            }
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            cfg->batch = atoi(argv[i] + 8);
+            if (cfg->batch < 1 || cfg->batch > 1024) {  // UIO_MAXIOV caps one recvmmsg()
+                fprintf(stderr, "Server: Batch Size Must Be 1..1024\n");
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--balance=rr") == 0) {
+            cfg->balance = BALANCE_RR;
+        } else if (strcmp(argv[i], "--balance=least") == 0) {
+            cfg->balance = BALANCE_LEAST;
+        } else if (strncmp(argv[i], "--high-water=", 13) == 0) {
+            cfg->high_water = strtoul(argv[i] + 13, NULL, 10);
+        } else if (strncmp(argv[i], "--low-water=", 12) == 0) {
+            cfg->low_water = strtoul(argv[i] + 12, NULL, 10);
+        } else if (strncmp(argv[i], "--log-level=", 12) == 0) {
+            const char *level = argv[i] + 12;
+            size_t l;
+            for (l = 0; l < sizeof(level_names) / sizeof(level_names[0]); l++) {
+                if (strcmp(level, level_names[l]) == 0) {
+                    break;
+                }
+            }
+            if (l == sizeof(level_names) / sizeof(level_names[0])) {
+                fprintf(stderr, "Server: Unknown Log Level '%s'\n", level);
+                usage(argv[0]);
+            }
+            cfg->log_level = l;
+        } else if (strncmp(argv[i], "--log-sample=", 13) == 0) {
+            cfg->log_sample = atoi(argv[i] + 13);
+            if (cfg->log_sample < 1) {
+                fprintf(stderr, "Server: Log Sample Rate Must Be Positive\n");
+                usage(argv[0]);
+            }
+        } else if (strncmp(argv[i], "--idle-timeout=", 15) == 0) {
+            cfg->idle_timeout = atoi(argv[i] + 15);
+            if (cfg->idle_timeout < 0) {
+                fprintf(stderr, "Server: Idle Timeout Must Not Be Negative\n");
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--low-latency") == 0) {
+            cfg->low_latency = 1;
+        } else if (strncmp(argv[i], "--busy-poll=", 12) == 0) {
+            cfg->busy_poll = atoi(argv[i] + 12);
+            if (cfg->busy_poll < 0) {
+                fprintf(stderr, "Server: Busy Poll Time Must Not Be Negative\n");
+                usage(argv[0]);
+            }
+        } else if (strncmp(argv[i], "--spin=", 7) == 0) {
+            cfg->spin_us = atoi(argv[i] + 7);
+            if (cfg->spin_us < 0) {
+                fprintf(stderr, "Server: Spin Time Must Not Be Negative\n");
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--zerocopy") == 0) {
+            cfg->zerocopy = 16 * 1024;  // below ~10 KB page pinning costs more than the copy
+        } else if (strncmp(argv[i], "--zerocopy=", 11) == 0) {
+            cfg->zerocopy = strtoul(argv[i] + 11, NULL, 10);
+            if (cfg->zerocopy == 0) {
+                fprintf(stderr, "Server: Zero-Copy Threshold Must Be Positive\n");
+                usage(argv[0]);
+            }
+        } else if (strncmp(argv[i], "--unix=", 7) == 0) {
+            cfg->unix_path = argv[i] + 7;
+            if (cfg->unix_path[0] == '\0' ||
+                strlen(cfg->unix_path) >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+                fprintf(stderr, "Server: Unix Socket Path Must Be 1..%zu Characters\n",
+                        sizeof(((struct sockaddr_un *)0)->sun_path) - 1);
+                usage(argv[0]);
+            }
+        } else if (strncmp(argv[i], "--cpus=", 7) == 0) {
+            cfg->cpus = argv[i] + 7;
+        } else if (strncmp(argv[i], "--irq-affinity=", 15) == 0) {
+            cfg->irq_iface = argv[i] + 15;
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            cfg->numa = 1;
+        } else if (strncmp(argv[i], "--max-line=", 11) == 0) {
+            cfg->max_line = strtoul(argv[i] + 11, NULL, 10);
+            if (cfg->max_line < MAXLINE || cfg->max_line > MAX_LINE_LIMIT) {
+                fprintf(stderr, "Server: --max-line Must Be %d..%d Bytes\n", MAXLINE, MAX_LINE_LIMIT);
+                usage(argv[0]);
+            }
+        } else if (strncmp(argv[i], "--stack-size=", 13) == 0) {
+            cfg->stack_size = strtoul(argv[i] + 13, NULL, 10);
+            if (cfg->stack_size < CORO_STACK_MIN || cfg->stack_size > CORO_STACK_MAX) {
+                fprintf(stderr, "Server: --stack-size Must Be %d..%d Bytes\n", CORO_STACK_MIN,
+                        CORO_STACK_MAX);
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--timestamps") == 0) {
+            cfg->timestamps = 1;
+        } else if (strcmp(argv[i], "--splice") == 0) {
+            cfg->splice = 1;
+        } else if (argv[i][0] == '-' || port_arg != NULL) {
+            usage(argv[0]);
+        } else {
+            port_arg = argv[i];
+        }
     }
 
-    int port = atoi(argv[1]);  // convert argument to int
+    if (port_arg == NULL && cfg->unix_path == NULL) {  // need a port, a socket path or both
+        usage(argv[0]);
+    }
+    cfg->port = port_arg != NULL ? atoi(port_arg) : -1;  // convert argument to int
+    if (cfg->port < 0 && cfg->mode == MODE_UDP) {
+        fprintf(stderr, "Server: --mode=%s Needs a Port\n", mode_names[cfg->mode]);
+        usage(argv[0]);
+    }
+    if (cfg->unix_path != NULL && cfg->mode == MODE_UDP) {
+        fprintf(stderr, "Server: --unix Serves Stream Connections, Not --mode=udp\n");
+        usage(argv[0]);
+    }
+    if (cfg->mode == MODE_CORO && (cfg->splice || cfg->zerocopy > 0 || cfg->timestamps ||
+                                   cfg->idle_timeout > 0)) {
+        fprintf(stderr, "Server: --mode=coro Takes No --splice, --zerocopy, --timestamps"
+                        " or --idle-timeout\n");
+        usage(argv[0]);
+    }
+    if (cfg->splice && (cfg->mode == MODE_FORK || cfg->mode == MODE_URING || cfg->mode == MODE_UDP)) {
+        fprintf(stderr, "Server: --splice Needs an epoll Based Mode (epoll, prefork, reactor)\n");
+        usage(argv[0]);
+    }
+    if (cfg->zerocopy > 0 && (cfg->splice || cfg->mode == MODE_FORK || cfg->mode == MODE_URING ||
+                              cfg->mode == MODE_UDP)) {
+        fprintf(stderr, "Server: --zerocopy Needs an epoll Based Mode (epoll, prefork, reactor)"
+                        " Without --splice\n");
+        usage(argv[0]);
+    }
+    if (cfg->low_latency && cfg->mode == MODE_UDP) {
+        fprintf(stderr, "Server: --low-latency Tunes TCP Connections, Not --mode=udp\n");
+        usage(argv[0]);
+    }
+    if (cfg->cpus != NULL && cfg->irq_iface != NULL) {
+        fprintf(stderr, "Server: Give Either --cpus or --irq-affinity\n");
+        usage(argv[0]);
+    }
+    if (cfg->numa && cfg->cpus == NULL && cfg->irq_iface == NULL) {
+        fprintf(stderr, "Server: --numa Needs --cpus or --irq-affinity to Know Each Loop's Node\n");
+        usage(argv[0]);
+    }
+    if ((cfg->cpus != NULL || cfg->irq_iface != NULL) && cfg->mode == MODE_FORK) {
+        fprintf(stderr, "Server: --cpus and --irq-affinity Place Event Loops, Not --mode=fork Children\n");
+        usage(argv[0]);
+    }
+    if (cfg->timestamps && (cfg->splice || cfg->zerocopy > 0 || cfg->mode == MODE_URING ||
+                            cfg->mode == MODE_UDP)) {
+        fprintf(stderr, "Server: --timestamps Needs fork or an epoll Based Mode"
+                        " Without --splice or --zerocopy\n");
+        usage(argv[0]);
+    }
+    if (cfg->high_water == 0 || cfg->low_water >= cfg->high_water) {
+        fprintf(stderr, "Server: Need 0 <= --low-water < --high-water\n");
+        usage(argv[0]);
+    }
+    cfg->reuseport = cfg->mode == MODE_PREFORK;  // workers share the port, kernel balances accepts
+    if (cfg->workers < 1) {
+        cfg->workers = 1;
+    }
+    if (cfg->threads < 1) {
+        cfg->threads = 1;
+    }
+}
 
-    int listenfd, connfd;
-    pid_t childpid;
-    socklen_t clilen;
-    struct sockaddr_in cliaddr, servaddr;  // client and server address structures
+// create, bind and listen on the server socket
+int create_listener(const struct server_config *cfg) {
+    struct sockaddr_in servaddr;  // server address structure
 
-    listenfd = socket(AF_INET, SOCK_STREAM, 0);  // socket for listening - IPV4, TCP
+    int listenfd = socket(AF_INET, SOCK_STREAM, 0);  // socket for listening - IPV4, TCP
     if (listenfd < 0) {
         perror("Server: Socket Creation Error");
         exit(EXIT_FAILURE);
     }
 
+    // allow quick restarts while old connections sit in TIME_WAIT
+    int on = 1;
+    if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+        perror("Server: Socket Option Setup Failed.");
+        exit(EXIT_FAILURE);
+    }
+
+    // each prefork worker binds its own socket to the same port
+    if (cfg->reuseport && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        perror("Server: SO_REUSEPORT");
+        exit(EXIT_FAILURE);
+    }
+
     // zero out server address structure and set its fields
     memset(&servaddr, 0, sizeof(servaddr));
     servaddr.sin_family = AF_INET;  // IPV4
     servaddr.sin_addr.s_addr = htonl(INADDR_ANY);  // listen on any available network interface
-    servaddr.sin_port = htons(port);  // set server port from command-line argument
+    servaddr.sin_port = htons(cfg->port);  // set server port from command-line argument
 
     // bind socket to specified address and port
     if (bind(listenfd, (struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
@@ -129,29 +483,254 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
-    // start listening for incoming connections - backlog of 10 connection
-    if (listen(listenfd, 10) < 0) {
+    // start listening; a short queue overflows under connection storms and the
+    // kernel then drops SYNs, which clients see as multi-second connect stalls
+    if (listen(listenfd, cfg->backlog) < 0) {
         perror("Server: Listening Error");
         exit(EXIT_FAILURE);
     }
 
-    printf("Server: Listening on Port %d\n", port);
+    // every mode drains the queue until EAGAIN, so the listener never blocks
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        perror("Server: fcntl O_NONBLOCK");
+        exit(EXIT_FAILURE);
+    }
+    accept_init(listenfd, cfg->backlog);
 
-    // main server loop to accept and handle client connections
-    while (1) {
-        clilen = sizeof(cliaddr);  // size of client address structure
-        connfd = accept(listenfd, (struct sockaddr *)&cliaddr, &clilen);  // accept client connection
-        if (connfd < 0) {
-            perror("Server: Accept Failed.");
-            continue;  // continue to next iteration
+    return listenfd;
+}
+
+// nonzero for an AF_UNIX socket, which takes none of the TCP options
+int socket_is_unix(int fd) {
+    int domain = 0;
+    socklen_t len = sizeof(domain);
+    getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len);
+    return domain == AF_UNIX;
+}
+
+// create, bind and listen on a Unix stream socket at cfg->unix_path
+int create_unix_listener(const struct server_config *cfg) {
+    struct sockaddr_un addr;
+    struct stat st;
+
+    int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenfd < 0) {
+        perror("Server: Socket Creation Error");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, cfg->unix_path, sizeof(addr.sun_path) - 1);
+
+    // a socket file left by a server that did not exit cleanly blocks bind(); only
+    // remove it if it really is a socket
+    if (lstat(cfg->unix_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(cfg->unix_path);
+    }
+    if (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Server: Bind Error");
+        exit(EXIT_FAILURE);
+    }
+    if (listen(listenfd, cfg->backlog) < 0) {
+        perror("Server: Listening Error");
+        exit(EXIT_FAILURE);
+    }
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        perror("Server: fcntl O_NONBLOCK");
+        exit(EXIT_FAILURE);
+    }
+    accept_init(listenfd, cfg->backlog);
+
+    return listenfd;
+}
+
+void open_listeners(const struct server_config *cfg, struct listeners *ls) {
+    ls->n = 0;
+    if (cfg->port >= 0) {
+        ls->fd[ls->n++] = create_listener(cfg);
+    }
+    if (cfg->unix_path != NULL) {
+        ls->fd[ls->n++] = create_unix_listener(cfg);
+    }
+}
+
+void describe_listeners(const struct server_config *cfg, char *buf, size_t len) {
+    if (cfg->port >= 0 && cfg->unix_path != NULL) {
+        snprintf(buf, len, "Port %d and %s", cfg->port, cfg->unix_path);
+    } else if (cfg->port >= 0) {
+        snprintf(buf, len, "Port %d", cfg->port);
+    } else {
+        snprintf(buf, len, "%s", cfg->unix_path);
+    }
+}
+
+// --low-latency: push small echoes out at once and let the kernel busy-poll the device
+void tune_connection(int fd, const struct server_config *cfg) {
+    static int warned;  // one warning, not one per connection
+    int on = 1;
+
+    if (!cfg->low_latency || socket_is_unix(fd)) {
+        return;  // Unix sockets have no Nagle, delayed ACKs or device queue to tune
+    }
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0) {
+        perror("Server: TCP_NODELAY");
+    }
+    rearm_quickack(fd);
+    // raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &cfg->busy_poll, sizeof(cfg->busy_poll)) < 0 &&
+        !__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+        perror("Server: SO_BUSY_POLL (continuing without it)");
+    }
+}
+
+// ACK every segment right away instead of waiting up to 40 ms to piggyback it
+void rearm_quickack(int fd) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+}
+
+// fork mode state the accept callback needs
+struct fork_ctx {
+    const struct listeners *ls;
+    const struct server_config *cfg;
+};
+
+// fork a child process to serve one accepted connection
+static void fork_child(int connfd, void *arg) {
+    const struct fork_ctx *fc = arg;
+    const struct server_config *cfg = fc->cfg;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Server: Fork Failed");
+    } else if (pid == 0) {  // child process
+        for (int i = 0; i < fc->ls->n; i++) {
+            close(fc->ls->fd[i]);  // child closes listening sockets
+        }
+        if (cfg->idle_timeout > 0) {
+            // one connection per process, so the kernel's socket timeouts are the idle timer
+            struct timeval tv = { .tv_sec = cfg->idle_timeout };
+            idle_timeout = cfg->idle_timeout;
+            setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(connfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        }
+        tune_connection(connfd, cfg);
+        low_latency = cfg->low_latency;
+        max_line = cfg->max_line;
+        if (cfg->timestamps && !socket_is_unix(connfd) && tstamp_enable(connfd) == 0) {
+            timestamps = tstamp_hists_new("connection");
         }
+        stats_install_signal(0);  // the blocking read returns EINTR, so an idle child dumps too
+        log_start();  // this connection's log flusher
+        response(connfd);  // handle client request - echo data back
+        log_stop();  // write out buffered log records
+        exit(0);  // child process exits after handling request
+    }
+    close(connfd);  // parent closes connected socket - child handles connection
+}
+
+// accept connections and fork a child process to serve each one
+static void run_fork_server(const struct listeners *ls, const struct server_config *cfg) {
+    struct fork_ctx fc = { .ls = ls, .cfg = cfg };
+    struct pollfd pfd[MAX_LISTENERS];
+
+    for (int i = 0; i < ls->n; i++) {
+        pfd[i].fd = ls->fd[i];
+        pfd[i].events = POLLIN;
+    }
+
+    // signal handler for SIGCHLD for zombie processes
+    struct sigaction sa;
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
+        perror("Server: SIGACTION");
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGUSR1, SIG_IGN);  // counters live in the children - signal those instead
 
-        // fork new process to handle client connection
-        if ((childpid = fork()) == 0) {  // child process
-            close(listenfd);  // child closes listening socket
-            response(connfd);  // handle client request - echo data back
-            exit(0);  // child process exits after handling request
+    // main server loop: wait for the listeners, then fork once per queued connection;
+    // the children get blocking sockets (no SOCK_NONBLOCK)
+    while (1) {
+        if (poll(pfd, ls->n, -1) < 0) {
+            if (errno != EINTR) {  // SIGCHLD interrupts poll() despite SA_RESTART
+                perror("Server: poll");
+            }
+            continue;
+        }
+        for (int i = 0; i < ls->n; i++) {
+            if (pfd[i].revents) {
+                accept_drain(ls->fd[i], SOCK_CLOEXEC, fork_child, &fc);
+            }
         }
-        close(connfd);  // parent closes connected socket - child handles connection
     }
 }
+
+int main(int argc, char **argv) {
+    struct server_config cfg;
+    struct listeners ls;
+    char where[160];
+
+    parse_args(argc, argv, &cfg);
+    stats_install_signal(cfg.mode != MODE_UDP);  // SIGUSR1 dumps echo counters
+    log_configure(cfg.log_level, cfg.log_sample);
+
+    // one event loop per worker process or thread, or a single one
+    if (cfg.mode == MODE_PREFORK) {
+        placement_init(&cfg, cfg.workers, "worker");
+    } else if (cfg.mode == MODE_REACTOR || cfg.mode == MODE_UDP) {
+        placement_init(&cfg, cfg.threads, mode_names[cfg.mode]);
+    } else if (cfg.mode != MODE_FORK) {
+        placement_init(&cfg, 1, mode_names[cfg.mode]);
+    }
+
+    if (cfg.mode == MODE_PREFORK) {
+        run_prefork_server(&cfg);  // workers open their own listeners
+        return 0;
+    }
+    if (cfg.mode == MODE_UDP) {
+        run_udp_server(&cfg);  // no TCP listener
+        return 0;
+    }
+
+    open_listeners(&cfg, &ls);
+
+    describe_listeners(&cfg, where, sizeof(where));
+    printf("Server: Listening on %s (%s mode%s%s%s%s)\n", where, mode_names[cfg.mode],
+           cfg.splice ? ", splice echo" : "", cfg.low_latency ? ", low latency" : "",
+           cfg.zerocopy ? ", zero-copy sends" : "", cfg.timestamps ? ", timestamps" : "");
+    fflush(stdout);  // keep forked children from repeating buffered output
+
+    if (cfg.mode != MODE_FORK) {
+        log_start();  // fork mode starts one per child instead
+    }
+
+    switch (cfg.mode) {
+    case MODE_EPOLL:
+        placement_apply(0);  // after log_start(), so the log flusher is not pinned too
+        run_epoll_server(&ls, &cfg);
+        break;
+    case MODE_URING:
+        placement_apply(0);
+        run_uring_server(&ls, &cfg);
+        break;
+    case MODE_REACTOR:
+        run_reactor_server(&ls, &cfg);
+        break;
+    case MODE_CORO:
+        placement_apply(0);
+        run_coro_server(&ls, &cfg);
+        break;
+    case MODE_FORK:
+    default:
+        run_fork_server(&ls, &cfg);
+        break;
+    }
+
+    for (int i = 0; i < ls.n; i++) {
+        close(ls.fd[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <sys/types.h>
+
+struct linebuf;
+struct echo_stats;
+
+#define MAXLINE 1024  // maximum buffer size
+#define MAX_LINE_LIMIT (64 << 20)  // largest --max-line
+#define MAX_LISTENERS 2  // the TCP port and the --unix path
+
+// how the server handles accepted connections
+enum server_mode {
+    MODE_FORK,     // fork a child process per connection
+    MODE_EPOLL,    // single process, non-blocking epoll event loop
+    MODE_PREFORK,  // pre-forked epoll workers on SO_REUSEPORT listeners
+    MODE_URING,    // single thread driving accept/recv/send through io_uring
+    MODE_REACTOR,  // one epoll reactor thread per core, fed by an acceptor
+    MODE_UDP,      // UDP echo, recvmmsg()/sendmmsg() batches on SO_REUSEPORT sockets
+    MODE_CORO,     // one coroutine per connection on a single epoll loop
+};
+
+// how the reactor mode spreads accepted connections over threads
+enum balance_policy {
+    BALANCE_RR,     // round-robin
+    BALANCE_LEAST,  // reactor with the fewest live connections
+};
+
+// runtime configuration parsed from the command line
+struct server_config {
+    enum server_mode mode;
+    int port;       // TCP port, -1 to listen on --unix only
+    const char *unix_path;  // also (or only) listen on this Unix stream socket
+    int backlog;    // listen() queue length, capped by net.core.somaxconn
+    int workers;    // prefork worker count
+    int threads;    // reactor thread count, or UDP socket count
+    int batch;      // UDP datagrams per recvmmsg()/sendmmsg()
+    enum balance_policy balance;
+    int reuseport;  // set SO_REUSEPORT on the listening socket
+    int splice;     // echo through a per-connection pipe with splice(), no line logging
+    size_t high_water;  // epoll and uring modes: stop reading a client once this much echo is queued
+    size_t low_water;   // ...and resume once its queue drains to this
+    int log_level;      // enum log_level
+    int log_sample;     // log 1 in N received lines
+    int idle_timeout;   // seconds without traffic before a connection is closed, 0 = never
+    int low_latency;    // TCP_NODELAY, TCP_QUICKACK and SO_BUSY_POLL on every connection
+    int busy_poll;      // SO_BUSY_POLL budget in microseconds
+    int spin_us;        // poll without sleeping this long before blocking for events
+    size_t zerocopy;    // epoll modes: send flushes of at least this many bytes with MSG_ZEROCOPY, 0 = off
+    const char *cpus;       // pin event loops to these CPUs, e.g. "0-3,8"
+    const char *irq_iface;  // ...or to the CPUs serving this NIC's queue IRQs
+    int numa;               // keep each loop's memory on its CPU's NUMA node
+    int timestamps;     // SO_TIMESTAMPING per-stage latency histograms on TCP connections
+    size_t max_line;    // longest line echoed in one piece; receive buffers grow up to it
+    size_t stack_size;  // coro mode: stack bytes per connection, plus a guard page
+};
+
+// listening sockets a mode accepts on: the TCP port, the Unix socket, or both
+struct listeners {
+    int fd[MAX_LISTENERS];
+    int n;
+};
+
+// blocking I/O helpers used by the fork mode (server.c)
+int writen(int fd, const char *vptr, size_t n);
+void response(int sockfd);
+
+// log and gather all complete buffered lines into one span for a single send; a line
+// longer than max_line is handed out in max_line pieces (server.c)
+size_t collect_lines(struct linebuf *lb, size_t max_line, int eof, const char **span,
+                     struct echo_stats *st);
+
+// log and count lines in bytes echoed as received, carrying a partial line over (server.c)
+void log_stream(const char *p, size_t len, int *line_start, int *line_logged, struct echo_stats *st);
+
+// bind and listen on cfg->port, or on cfg->unix_path; open_listeners() opens whichever
+// cfg asks for (server.c)
+int create_listener(const struct server_config *cfg);
+int create_unix_listener(const struct server_config *cfg);
+void open_listeners(const struct server_config *cfg, struct listeners *ls);
+void describe_listeners(const struct server_config *cfg, char *buf, size_t len);  // "Port N and PATH"
+
+// --low-latency socket options for an accepted connection (server.c);
+// the kernel drops TCP_QUICKACK again, so it is re-armed after every read
+void tune_connection(int fd, const struct server_config *cfg);
+int socket_is_unix(int fd);
+void rearm_quickack(int fd);
+
+// event loop modes (epoll_server.c)
+void run_epoll_server(const struct listeners *ls, const struct server_config *cfg);
+void run_reactor_server(const struct listeners *ls, const struct server_config *cfg);
+
+// pre-forked worker pool with a respawning supervisor (prefork.c)
+void run_prefork_server(const struct server_config *cfg);
+
+// io_uring backend (uring_server.c)
+void run_uring_server(const struct listeners *ls, const struct server_config *cfg);
+
+// UDP echo, opens its own sockets (udp_server.c)
+void run_udp_server(const struct server_config *cfg);
+
+// coroutine per connection on one epoll loop (coro_server.c)
+void run_coro_server(const struct listeners *ls, const struct server_config *cfg);
+
+#endif // SERVER_H
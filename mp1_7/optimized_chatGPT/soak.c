@@ -0,0 +1,557 @@
+// soak.c - client --soak: many long-lived echo sessions from one process
+//
+// Every session connects, sends a line, waits for the whole echo and then
+// pauses for a randomized interval before the next line, for hours if asked.
+// One epoll loop drives all of them and one timer wheel holds each session's
+// next deadline: its connect slot in the startup ramp, its next line, its echo
+// timeout or its reconnect backoff. A dropped session (closed by the server,
+// mismatched echo, timeout) reconnects on its own. Report lines show each
+// interval's traffic, failures and RTT percentiles next to the first full
+// interval's, so slow degradation shows up as drift.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "soak.h"
+#include "hist.h"
+#include "wheel.h"
+
+#define MAX_EVENTS 1024
+#define RECV_SIZE 65536
+#define BACKOFF_MIN_MS 100     // first reconnect delay, doubled per consecutive failure...
+#define BACKOFF_MAX_MS 5000    // ...up to this
+#define BASELINE_SAMPLES 100   // echoes an interval needs to become the drift baseline
+#define RESERVED_FDS 16        // descriptors kept free of sessions (stdio, epoll, /proc)
+#define SOAK_TICK_MS 5         // timer resolution: lines start spread out, not in 100 ms bursts
+
+enum session_state {
+    S_WAITING,     // not connected; the timer starts the next connect
+    S_CONNECTING,  // connect in progress; the timer is its timeout
+    S_OPEN,        // the timer sends the next line, or times out the one in flight
+};
+
+struct session {
+    int fd;
+    int id;
+    enum session_state state;
+    uint32_t events;          // epoll interest currently registered
+    struct timer_node timer;
+    uint64_t seq;             // lines started on this session
+    int connected;            // connected before - the next connect is a reconnect
+    int failures;             // consecutive drops, for the backoff
+    const char *line;         // line in flight, NULL between lines
+    size_t len;
+    size_t sent;              // bytes of it written
+    size_t echoed;            // bytes of it echoed and verified
+    uint64_t sent_ns;         // when it was started
+    char *gen;                // storage for generated lines
+};
+
+struct soak_stats {
+    uint64_t lines;           // echoes completed
+    uint64_t mismatched;      // echoes that differed from the line sent
+    uint64_t timeouts;        // echo or connect later than --timeout
+    uint64_t closed;          // open sessions closed or reset by the server
+    uint64_t connect_failed;
+    uint64_t reconnects;
+};
+
+static const struct soak_config *cfg;
+static struct session *sessions;
+static struct timer_wheel wheel;
+static int epfd;
+static int nsessions;                    // after fit_fd_limit()
+static int open_sessions;
+static int first_connects;               // sessions that have connected at least once
+static uint64_t ramped_ns;               // when the last of them did
+static struct soak_stats total;
+static struct soak_stats prev;           // totals at the previous report
+static struct hist rtt_all;              // ns, whole run
+static struct hist rtt_interval;         // ns, since the previous report
+static uint64_t base_p50, base_p99;      // first interval after the ramp with BASELINE_SAMPLES echoes
+static long long base_rss_kb = -1;       // --server-pid: RSS at the first report
+static char **script;                    // --script lines, newline included
+static size_t *script_len;
+static size_t nscript;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+static volatile sig_atomic_t stopping;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stop_handler(int signo) {
+    stopping = 1;
+}
+
+// xorshift64: cheap and good enough to spread sessions out
+static uint64_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// uniform in [ms/2, 3ms/2], so sessions never fall into lockstep
+static uint64_t jitter(uint64_t ms) {
+    return ms / 2 + rnd() % (ms + 1);
+}
+
+static int load_script(const char *path) {
+    FILE *f = fopen(path, "r");
+    char *line = NULL;
+    size_t cap = 0, alloc = 0;
+    ssize_t n;
+
+    if (f == NULL) {
+        perror("Opening Script Failed");
+        return -1;
+    }
+    while ((n = getline(&line, &cap, f)) > 0) {
+        if (nscript == alloc) {
+            alloc = alloc ? alloc * 2 : 64;
+            script = realloc(script, alloc * sizeof(*script));
+            script_len = realloc(script_len, alloc * sizeof(*script_len));
+            if (script == NULL || script_len == NULL) {
+                perror("Out of Memory");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (line[n - 1] != '\n') {  // last line without a newline - the echo is framed by lines
+            line = realloc(line, n + 2);
+            line[n++] = '\n';
+            line[n] = '\0';
+        }
+        script[nscript] = strndup(line, n);
+        script_len[nscript++] = n;
+    }
+    free(line);
+    fclose(f);
+    if (nscript == 0) {
+        fprintf(stderr, "Script %s Has No Lines\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// pick the next line: the script in order from a per-session offset, or a generated
+// line of random length carrying the session id and sequence number, so an echo
+// delivered to the wrong session or out of order cannot match
+static void next_line(struct session *s) {
+    if (nscript > 0) {
+        size_t i = (s->id + s->seq) % nscript;
+        s->line = script[i];
+        s->len = script_len[i];
+        return;
+    }
+    int min = cfg->size < 32 ? cfg->size : 32;
+    size_t len = min + rnd() % (cfg->size - min + 1);
+    int head = snprintf(s->gen, cfg->size, "%d %llu ", s->id, (unsigned long long)s->seq);
+    if ((size_t)head > len - 1) {
+        head = len - 1;  // very short --size: the header is cut off
+    }
+    for (size_t i = head; i < len - 1; i++) {
+        s->gen[i] = 'a' + (i + s->seq) % 26;
+    }
+    s->gen[len - 1] = '\n';
+    s->line = s->gen;
+    s->len = len;
+}
+
+static void set_interest(struct session *s, uint32_t want) {
+    if (want == s->events) {
+        return;
+    }
+    struct epoll_event ev = { .events = want, .data.ptr = s };
+    if (epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev) == 0) {
+        s->events = want;
+    }
+}
+
+// give up on the connection and reconnect after a backoff that doubles per failure
+static void session_drop(struct session *s, uint64_t *counter) {
+    (*counter)++;
+    if (s->state == S_OPEN) {
+        open_sessions--;
+    }
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+    s->state = S_WAITING;
+    s->line = NULL;
+    uint64_t backoff = BACKOFF_MIN_MS << (s->failures < 6 ? s->failures : 6);
+    if (backoff > BACKOFF_MAX_MS) {
+        backoff = BACKOFF_MAX_MS;
+    }
+    s->failures++;
+    wheel_add(&wheel, &s->timer, wheel_now_ms() + jitter(backoff));
+}
+
+static void session_connected(struct session *s) {
+    s->state = S_OPEN;
+    open_sessions++;
+    if (s->connected) {
+        total.reconnects++;
+    } else if (++first_connects == nsessions) {
+        ramped_ns = now_ns();
+    }
+    s->connected = 1;
+    set_interest(s, EPOLLIN);
+    wheel_add(&wheel, &s->timer, wheel_now_ms() + jitter(cfg->interval_ms));
+}
+
+static void session_connect(struct session *s) {
+    const struct sockaddr_storage *addr = &cfg->addr[s->id % cfg->ntargets];
+    socklen_t addr_len = cfg->addr_len[s->id % cfg->ntargets];
+    int on = 1;
+
+    s->fd = socket(addr->ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->fd < 0) {
+        session_drop(s, &total.connect_failed);  // e.g. EMFILE
+        return;
+    }
+    if (cfg->low_latency && addr->ss_family != AF_UNIX) {
+        setsockopt(s->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    s->state = S_CONNECTING;
+    s->events = EPOLLOUT;
+    struct epoll_event ev = { .events = s->events, .data.ptr = s };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev) < 0) {
+        session_drop(s, &total.connect_failed);
+        return;
+    }
+    if (connect(s->fd, (const struct sockaddr *)addr, addr_len) < 0 && errno != EINPROGRESS) {
+        session_drop(s, &total.connect_failed);  // e.g. ECONNREFUSED while the server restarts
+        return;
+    }
+    wheel_add(&wheel, &s->timer, wheel_now_ms() + cfg->timeout_s * 1000ULL);
+}
+
+// write what is left of the line in flight
+static void session_send(struct session *s) {
+    while (s->sent < s->len) {
+        ssize_t n = send(s->fd, s->line + s->sent, s->len - s->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                set_interest(s, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            session_drop(s, &total.closed);
+            return;
+        }
+        s->sent += n;
+    }
+    set_interest(s, EPOLLIN);
+}
+
+static void start_line(struct session *s) {
+    next_line(s);
+    s->seq++;
+    s->sent = s->echoed = 0;
+    s->sent_ns = now_ns();
+    wheel_add(&wheel, &s->timer, wheel_now_ms() + cfg->timeout_s * 1000ULL);
+    session_send(s);
+}
+
+// verify echoed bytes against the line in flight; anything else on the stream is a
+// mismatch, and since the stream cannot be resynchronised the session reconnects
+static void session_read(struct session *s) {
+    static char buf[RECV_SIZE];
+    ssize_t n = recv(s->fd, buf, sizeof(buf), 0);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        session_drop(s, &total.closed);
+        return;
+    }
+    if (s->line == NULL || (size_t)n > s->len - s->echoed ||
+        memcmp(buf, s->line + s->echoed, n) != 0) {
+        session_drop(s, &total.mismatched);
+        return;
+    }
+    s->echoed += n;
+    if (s->echoed < s->len) {
+        return;
+    }
+    uint64_t rtt = now_ns() - s->sent_ns;
+    hist_record(&rtt_all, rtt);
+    hist_record(&rtt_interval, rtt);
+    total.lines++;
+    s->failures = 0;  // a full round trip - the next drop starts the backoff over
+    s->line = NULL;
+    wheel_add(&wheel, &s->timer, wheel_now_ms() + jitter(cfg->interval_ms));
+}
+
+static void session_event(struct session *s, uint32_t events) {
+    if (s->state == S_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            session_drop(s, &total.connect_failed);
+        } else {
+            session_connected(s);
+        }
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        session_read(s);
+    }
+    if (s->state == S_OPEN && s->line != NULL && (events & EPOLLOUT)) {
+        session_send(s);
+    }
+}
+
+static void timer_expired(struct timer_node *t, void *arg) {
+    struct session *s = (struct session *)((char *)t - offsetof(struct session, timer));
+
+    switch (s->state) {
+    case S_WAITING:
+        session_connect(s);
+        break;
+    case S_CONNECTING:
+        session_drop(s, &total.timeouts);
+        break;
+    case S_OPEN:
+        if (s->line == NULL) {
+            start_line(s);
+        } else {
+            session_drop(s, &total.timeouts);  // echo overdue
+        }
+        break;
+    }
+}
+
+// --server-pid: resident memory and open descriptors of the server under test
+static int read_server(long long *rss_kb, int *fds) {
+    char path[64], line[256];
+    FILE *f;
+    DIR *d;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", cfg->server_pid);
+    if ((f = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    *rss_kb = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmRSS: %lld", rss_kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", cfg->server_pid);
+    *fds = 0;
+    if ((d = opendir(path)) != NULL) {
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL) {
+            *fds += e->d_name[0] != '.';
+        }
+        closedir(d);
+    }
+    return 0;
+}
+
+static void report(double elapsed, double span, int ramped) {
+    uint64_t p50 = hist_percentile(&rtt_interval, 50);
+    uint64_t p99 = hist_percentile(&rtt_interval, 99);
+
+    if (base_p50 == 0 && ramped && rtt_interval.total >= BASELINE_SAMPLES) {
+        base_p50 = p50;
+        base_p99 = p99;
+    }
+    printf("soak: [%6.0fs] open %d/%d  lines %llu (%.0f/s)  mismatched +%llu  timeouts +%llu"
+           "  closed +%llu  reconnects +%llu  connect failed +%llu", elapsed, open_sessions,
+           nsessions, (unsigned long long)(total.lines - prev.lines),
+           (total.lines - prev.lines) / span,
+           (unsigned long long)(total.mismatched - prev.mismatched),
+           (unsigned long long)(total.timeouts - prev.timeouts),
+           (unsigned long long)(total.closed - prev.closed),
+           (unsigned long long)(total.reconnects - prev.reconnects),
+           (unsigned long long)(total.connect_failed - prev.connect_failed));
+    if (rtt_interval.total > 0) {
+        printf("  rtt p50 %.0f us  p99 %.0f us  max %.0f us", p50 / 1e3, p99 / 1e3, rtt_interval.max / 1e3);
+        if (base_p50 > 0) {
+            printf("  drift p50 x%.2f p99 x%.2f", (double)p50 / base_p50, (double)p99 / base_p99);
+        } else {
+            printf("  drift -");  // no baseline yet
+        }
+    }
+    if (cfg->server_pid > 0) {
+        long long rss_kb;
+        int fds;
+        if (read_server(&rss_kb, &fds) == 0) {
+            if (base_rss_kb < 0) {
+                base_rss_kb = rss_kb;
+            }
+            printf("  server rss %lld KB (%+lld) fds %d", rss_kb, rss_kb - base_rss_kb, fds);
+        } else {
+            printf("  server gone");
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+    prev = total;
+    hist_init(&rtt_interval);
+}
+
+// make room for every session, or cut their number down to what the limit allows
+static int fit_fd_limit(int want) {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        return want;
+    }
+    if (rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (rl.rlim_cur != RLIM_INFINITY && (rlim_t)want + RESERVED_FDS > rl.rlim_cur) {
+        int fit = (int)rl.rlim_cur - RESERVED_FDS;
+        fprintf(stderr, "soak: fd limit %llu - running %d sessions instead of %d\n",
+                (unsigned long long)rl.rlim_cur, fit, want);
+        return fit;
+    }
+    return want;
+}
+
+// every TCP session to one server address needs its own local port
+static void check_port_range(int sessions) {
+    FILE *f = fopen("/proc/sys/net/ipv4/ip_local_port_range", "r");
+    int lo, hi;
+
+    if (cfg->addr[0].ss_family != AF_INET || f == NULL) {
+        if (f != NULL) {
+            fclose(f);
+        }
+        return;
+    }
+    if (fscanf(f, "%d %d", &lo, &hi) == 2 && sessions / cfg->ntargets > hi - lo + 1) {
+        fprintf(stderr, "soak: %d sessions per server address exceed the %d local ports -"
+                        " list more addresses (e.g. 127.0.0.1,127.0.0.2)\n",
+                sessions / cfg->ntargets, hi - lo + 1);
+    }
+    fclose(f);
+}
+
+int run_soak(const struct soak_config *config) {
+    struct epoll_event events[MAX_EVENTS];
+    struct sigaction sa;
+    int n;
+
+    cfg = config;
+    if (cfg->script != NULL && load_script(cfg->script) < 0) {
+        return EXIT_FAILURE;
+    }
+    n = nsessions = fit_fd_limit(cfg->sessions);
+    check_port_range(n);
+
+    sessions = calloc(n, sizeof(*sessions));
+    char *gen = nscript == 0 ? malloc((size_t)n * cfg->size) : NULL;
+    if (sessions == NULL || (nscript == 0 && gen == NULL)) {
+        perror("Out of Memory");
+        return EXIT_FAILURE;
+    }
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("epoll_create1 Failed");
+        return EXIT_FAILURE;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    rng_state ^= (uint64_t)getpid() << 32 ^ now_ns();
+    hist_init(&rtt_all);
+    hist_init(&rtt_interval);
+
+    // ramp: session i connects i/ramp seconds in, so startup is not a SYN flood
+    uint64_t start_ms = wheel_now_ms();
+    wheel_init(&wheel, start_ms, SOAK_TICK_MS);
+    for (int i = 0; i < n; i++) {
+        struct session *s = &sessions[i];
+        s->id = i;
+        s->fd = -1;
+        s->gen = gen != NULL ? gen + (size_t)i * cfg->size : NULL;
+        wheel_add(&wheel, &s->timer, start_ms + (uint64_t)i * 1000 / cfg->ramp);
+    }
+    printf("soak: %d sessions, one line every %d ms (randomized), %s lines, ramp %d/s, timeout %d s\n",
+           n, cfg->interval_ms, nscript > 0 ? cfg->script : "generated", cfg->ramp, cfg->timeout_s);
+    fflush(stdout);
+
+    uint64_t start = now_ns(), last_report = start;
+    // the drift baseline waits for the ramp: every session connected once, or (if some
+    // never get in) every session's first try timed out
+    uint64_t ramp_end = start + (uint64_t)n * 1000000000ULL / cfg->ramp + cfg->timeout_s * 1000000000ULL;
+    uint64_t end = cfg->duration > 0 ? start + (uint64_t)(cfg->duration * 1e9) : 0;
+    while (!stopping) {
+        uint64_t now = now_ns();
+        if (end != 0 && now >= end) {
+            break;
+        }
+        if (now - last_report >= cfg->report_s * 1000000000ULL) {
+            report((now - start) / 1e9, (now - last_report) / 1e9,
+                   (ramped_ns != 0 && last_report >= ramped_ns) || last_report >= ramp_end);
+            last_report = now;
+        }
+        int timeout = wheel_timeout_ms(&wheel, wheel_now_ms());
+        int until_report = (int)((last_report + cfg->report_s * 1000000000ULL - now) / 1000000) + 1;
+        if (timeout < 0 || timeout > until_report) {
+            timeout = until_report;
+        }
+        int ready = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        if (ready < 0 && errno != EINTR) {
+            perror("epoll_wait Failed");
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            session_event(events[i].data.ptr, events[i].events);
+        }
+        wheel_advance(&wheel, wheel_now_ms(), timer_expired, NULL);
+    }
+
+    uint64_t now = now_ns();
+    double elapsed = (now - start) / 1e9;
+    if (now - last_report >= 100000000ULL) {
+        report(elapsed, (now - last_report) / 1e9,  // the partial last interval
+               (ramped_ns != 0 && last_report >= ramped_ns) || last_report >= ramp_end);
+    }
+    printf("soak: %d sessions over %.0f s: %llu lines echoed, %llu mismatched, %llu timeouts,"
+           " %llu closed by server, %llu reconnects, %llu connect failures\n",
+           n, elapsed, (unsigned long long)total.lines, (unsigned long long)total.mismatched,
+           (unsigned long long)total.timeouts, (unsigned long long)total.closed,
+           (unsigned long long)total.reconnects, (unsigned long long)total.connect_failed);
+    hist_summary(&rtt_all, stdout, "rtt(us):", 1e3);
+
+    for (int i = 0; i < n; i++) {
+        if (sessions[i].fd >= 0) {
+            close(sessions[i].fd);
+        }
+    }
+    close(epfd);
+    free(sessions);
+    free(gen);
+    return total.mismatched > 0 ? 2 : 0;
+}
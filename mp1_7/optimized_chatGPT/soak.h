@@ -0,0 +1,32 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <sys/socket.h>
+
+#define SOAK_MAX_TARGETS 16  // server addresses sessions are spread over
+
+// soak mode of the client: many long-lived sessions on one epoll loop, each
+// sending a line, waiting for its echo and pausing a randomized interval.
+// Reconnects, mismatched echoes, timeouts and per-interval latency (against
+// the first interval, to show drift) are reported periodically.
+struct soak_config {
+    int sessions;
+    int interval_ms;      // mean pause between a session's lines (uniform 0.5x-1.5x)
+    int size;             // generated lines: longest line, newline included
+    const char *script;   // file of lines to send instead of generated ones
+    double duration;      // seconds; 0 runs until SIGINT/SIGTERM
+    int report_s;         // seconds between report lines
+    int ramp;             // sessions opened per second at startup
+    int timeout_s;        // echo or connect taking longer than this drops the session
+    int server_pid;       // > 0: report this process's RSS and open fds as well
+    int low_latency;      // TCP_NODELAY on every session
+    struct sockaddr_storage addr[SOAK_MAX_TARGETS];  // session i uses addr[i % ntargets]
+    socklen_t addr_len[SOAK_MAX_TARGETS];
+    int ntargets;
+};
+
+// run until the duration is over or a signal arrives; returns the exit status
+// (2 if any echo did not match, like echo_bench)
+int run_soak(const struct soak_config *cfg);
+
+#endif // SOAK_H
@@ -0,0 +1,112 @@
+#include <signal.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+#define MAX_SECTIONS 8
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct echo_stats *stats_list;
+static void (*sections[MAX_SECTIONS])(FILE *out);
+static int nsections;
+static volatile sig_atomic_t dump_pending;
+
+void stats_register(struct echo_stats *st, const char *name) {
+    st->name = name;
+    pthread_mutex_lock(&stats_lock);
+    st->next = stats_list;
+    stats_list = st;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void stats_add_section(void (*dump)(FILE *out)) {
+    pthread_mutex_lock(&stats_lock);
+    if (nsections < MAX_SECTIONS) {
+        sections[nsections++] = dump;
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void sigusr1_handler(int signo) {
+    dump_pending = 1;
+}
+
+void stats_install_signal(int restart) {
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigusr1_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = restart ? SA_RESTART : 0;  // blocking reads resume; epoll_wait() still returns EINTR
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+int stats_dump_requested(void) {
+    if (!dump_pending) {
+        return 0;
+    }
+    dump_pending = 0;
+    return 1;
+}
+
+static void print_line(FILE *out, const char *name, const struct echo_stats *st) {
+    fprintf(out, "Server Stats: %-10s lines %llu  bytes %llu  recv calls %llu  send calls %llu"
+                 "  lines/send %.2f  pauses %llu  queue peak %llu  idle closed %llu"
+                 "  spin hits %llu  spin sleeps %llu", name,
+            (unsigned long long)st->lines, (unsigned long long)st->bytes,
+            (unsigned long long)st->recv_calls, (unsigned long long)st->send_calls,
+            st->send_calls ? (double)st->lines / st->send_calls : 0.0,
+            (unsigned long long)st->pauses, (unsigned long long)st->queue_peak,
+            (unsigned long long)st->idle_closed, (unsigned long long)st->spin_hits,
+            (unsigned long long)st->spin_sleeps);
+    if (st->zc_sends > 0) {
+        fprintf(out, "  zerocopy sends %llu  bytes %llu  copied %llu",
+                (unsigned long long)st->zc_sends, (unsigned long long)st->zc_bytes,
+                (unsigned long long)st->zc_copied);
+    }
+    if (st->buf_grows > 0) {
+        fprintf(out, "  buffer grows %llu  buffer peak %llu",
+                (unsigned long long)st->buf_grows, (unsigned long long)st->buf_peak);
+    }
+    fprintf(out, "\n");
+}
+
+// counters are read without synchronisation - a dump may be a few events stale
+void stats_dump(FILE *out) {
+    struct echo_stats total;
+    int n = 0;
+
+    memset(&total, 0, sizeof(total));
+    pthread_mutex_lock(&stats_lock);
+    for (const struct echo_stats *st = stats_list; st != NULL; st = st->next) {
+        print_line(out, st->name, st);
+        total.lines += st->lines;
+        total.bytes += st->bytes;
+        total.recv_calls += st->recv_calls;
+        total.send_calls += st->send_calls;
+        total.pauses += st->pauses;
+        total.idle_closed += st->idle_closed;
+        total.spin_hits += st->spin_hits;
+        total.spin_sleeps += st->spin_sleeps;
+        total.zc_sends += st->zc_sends;
+        total.zc_bytes += st->zc_bytes;
+        total.zc_copied += st->zc_copied;
+        total.buf_grows += st->buf_grows;
+        if (st->queue_peak > total.queue_peak) {
+            total.queue_peak = st->queue_peak;
+        }
+        if (st->buf_peak > total.buf_peak) {
+            total.buf_peak = st->buf_peak;
+        }
+        n++;
+    }
+    if (n > 1) {
+        print_line(out, "total", &total);
+    }
+    for (int i = 0; i < nsections; i++) {
+        sections[i](out);
+    }
+    pthread_mutex_unlock(&stats_lock);
+    fflush(out);
+}
@@ -0,0 +1,40 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// echo path counters; each instance is only written by the thread that owns it
+struct echo_stats {
+    const char *name;     // label in the dump, e.g. "reactor 0"
+    uint64_t lines;       // lines echoed
+    uint64_t bytes;       // bytes echoed
+    uint64_t recv_calls;  // reads on the echo path
+    uint64_t send_calls;  // send()/writev() calls on the echo path
+    uint64_t pauses;      // times a connection stopped being read at the high watermark
+    uint64_t queue_peak;  // largest output queue seen on one connection, in bytes
+    uint64_t idle_closed; // connections closed by --idle-timeout
+    uint64_t spin_hits;   // --low-latency: waits answered while spinning
+    uint64_t spin_sleeps; // --low-latency: spins that ran out and went to sleep
+    uint64_t zc_sends;    // --zerocopy: sends made with MSG_ZEROCOPY
+    uint64_t zc_bytes;    // ...and the bytes they carried
+    uint64_t zc_copied;   // ...that the kernel copied after all (e.g. over loopback)
+    uint64_t buf_grows;   // receive buffers grown to hold a line longer than they were
+    uint64_t buf_peak;    // largest receive buffer one connection needed, in bytes
+    struct echo_stats *next;
+};
+
+// make a counter set visible to stats_dump()
+void stats_register(struct echo_stats *st, const char *name);
+
+// extra sections printed by stats_dump() (e.g. allocator or accept queue state)
+void stats_add_section(void (*dump)(FILE *out));
+
+// SIGUSR1 requests a dump; event loops poll stats_dump_requested() and call stats_dump().
+// Without `restart`, a blocking read the signal lands in fails with EINTR, so a loop
+// that sleeps in one (UDP recvmmsg()) dumps at once instead of on its next datagram
+void stats_install_signal(int restart);
+int stats_dump_requested(void);
+void stats_dump(FILE *out);
+
+#endif // STATS_H
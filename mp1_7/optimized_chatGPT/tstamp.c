@@ -0,0 +1,190 @@
+// tstamp.c - --timestamps: per-stage echo latency from SO_TIMESTAMPING
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+#include "tstamp.h"
+#include "stats.h"
+
+static const char *const stage_names[TS_STAGES] = {
+    [TS_RX_READ] = "rx->read",
+    [TS_READ_SEND] = "read->send",
+    [TS_SEND_TX] = "send->tx",
+    [TS_RX_TX] = "rx->tx",
+};
+
+static pthread_mutex_t hists_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tstamp_hists *hists_list;
+
+uint64_t tstamp_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t ts_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+// a later stamp minus an earlier one; clock steps between them would go negative
+static void record(struct tstamp_hists *h, enum tstamp_stage s, uint64_t from, uint64_t to) {
+    if (from != 0 && to >= from) {
+        hist_record(&h->stage[s], to - from);
+    }
+}
+
+// all loops' histograms merged; they are read without locking, like the echo
+// counters, so a dump may be a few samples stale
+static void dump_tstamps(FILE *out) {
+    static struct hist merged[TS_STAGES];  // too big for the stack of a reactor thread
+    char label[64];
+
+    for (int s = 0; s < TS_STAGES; s++) {
+        hist_init(&merged[s]);
+    }
+    pthread_mutex_lock(&hists_lock);
+    for (const struct tstamp_hists *h = hists_list; h != NULL; h = h->next) {
+        for (int s = 0; s < TS_STAGES; s++) {
+            hist_merge(&merged[s], &h->stage[s]);
+        }
+        if (h->unmatched > 0) {
+            fprintf(out, "Server Timestamps: %s  %llu transmit stamps unmatched\n", h->name,
+                    (unsigned long long)h->unmatched);
+        }
+    }
+    pthread_mutex_unlock(&hists_lock);
+    for (int s = 0; s < TS_STAGES; s++) {
+        snprintf(label, sizeof(label), "Server Timestamps: %s(us):", stage_names[s]);
+        hist_summary(&merged[s], out, label, 1e3);
+    }
+}
+
+struct tstamp_hists *tstamp_hists_new(const char *name) {
+    struct tstamp_hists *h = calloc(1, sizeof(*h));
+    static int registered;
+
+    if (h == NULL) {
+        perror("Server: Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+    h->name = name;
+    for (int s = 0; s < TS_STAGES; s++) {
+        hist_init(&h->stage[s]);
+    }
+    pthread_mutex_lock(&hists_lock);
+    h->next = hists_list;
+    hists_list = h;
+    pthread_mutex_unlock(&hists_lock);
+    // outside hists_lock: a dump takes the stats lock first, then hists_lock
+    if (!__atomic_exchange_n(&registered, 1, __ATOMIC_RELAXED)) {
+        stats_add_section(dump_tstamps);
+    }
+    return h;
+}
+
+int tstamp_enable(int fd) {
+    static int warned;
+    // OPT_TSONLY: transmit stamps come without a copy of the packet
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE |
+                SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+            perror("Server: SO_TIMESTAMPING (continuing without stamps)");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+void tstamp_conn_init(struct tstamp_conn *tc) {
+    memset(tc, 0, sizeof(*tc));
+}
+
+void tstamp_received(struct tstamp_conn *tc, const void *control, size_t controllen,
+                     struct tstamp_hists *h) {
+    struct msghdr msg = { .msg_control = (void *)control, .msg_controllen = controllen };
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPING) {
+            const struct scm_timestamping *st = (const struct scm_timestamping *)CMSG_DATA(cm);
+            tc->rx_kernel = ts_ns(&st->ts[0]);  // ts[0] is the software stamp
+            tc->rx_user = tstamp_now();
+            record(h, TS_RX_READ, tc->rx_kernel, tc->rx_user);
+        }
+    }
+}
+
+void tstamp_sent(struct tstamp_conn *tc, size_t n, uint64_t now, struct tstamp_hists *h) {
+    if (n == 0) {
+        return;
+    }
+    if (tc->rx_user != 0) {
+        record(h, TS_READ_SEND, tc->rx_user, now);
+        tc->rx_user = 0;  // later sends of the same read are the rest of one echo
+    }
+    tc->bytes += n;
+    if (tc->count == TSTAMP_PENDING) {  // stamps are not coming back - forget the oldest
+        tc->head = (tc->head + 1) % TSTAMP_PENDING;
+        tc->count--;
+    }
+    unsigned i = (tc->head + tc->count++) % TSTAMP_PENDING;
+    tc->pending[i].id = tc->bytes - 1;  // the kernel names a send by its last byte
+    tc->pending[i].rx_kernel = tc->rx_kernel;
+    tc->pending[i].send_user = now;
+}
+
+// match a transmit stamp with the send() it belongs to; sends before it that never
+// got one (e.g. a partial send stamped together with the next) are dropped
+static void transmitted(struct tstamp_conn *tc, uint32_t id, uint64_t tx, struct tstamp_hists *h) {
+    while (tc->count > 0) {
+        unsigned i = tc->head;
+        int32_t ahead = (int32_t)(id - tc->pending[i].id);
+        if (ahead < 0) {
+            break;  // older than anything pending
+        }
+        tc->head = (tc->head + 1) % TSTAMP_PENDING;
+        tc->count--;
+        if (ahead == 0) {
+            record(h, TS_SEND_TX, tc->pending[i].send_user, tx);
+            record(h, TS_RX_TX, tc->pending[i].rx_kernel, tx);
+            return;
+        }
+    }
+    h->unmatched++;
+}
+
+void tstamp_reap(int fd, struct tstamp_conn *tc, struct tstamp_hists *h) {
+    char control[256];
+
+    while (1) {
+        struct msghdr msg = { .msg_control = control, .msg_controllen = sizeof(control) };
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;  // EAGAIN: queue empty
+        }
+        uint64_t tx = 0;
+        const struct sock_extended_err *serr = NULL;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPING) {
+                tx = ts_ns(&((const struct scm_timestamping *)CMSG_DATA(cm))->ts[0]);
+            } else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                       (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                serr = (const struct sock_extended_err *)CMSG_DATA(cm);
+            }
+        }
+        if (tx != 0 && serr != NULL && serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING &&
+            serr->ee_info == SCM_TSTAMP_SND) {
+            transmitted(tc, serr->ee_data, tx, h);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef TSTAMP_H
+#define TSTAMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hist.h"
+
+// --timestamps: software SO_TIMESTAMPING on every TCP connection splits the time an
+// echo spends on the server side into stages, each kept in a histogram that is
+// printed on SIGUSR1:
+//   rx->read    kernel receive stamp to the read() that returned the data
+//   read->send  inside the server: framing, logging and queueing the echo
+//   send->tx    send() to the kernel's transmit stamp (hand-off to the device)
+//   rx->tx      the whole way from kernel receive to kernel transmit
+// Receive stamps come per read, so lines that arrive together share one. Transmit
+// stamps are matched to their send() by the byte offset SOF_TIMESTAMPING_OPT_ID
+// gives them.
+
+#define TSTAMP_PENDING 8    // sends per connection waiting for their transmit stamp
+#define TSTAMP_CONTROL 128  // control buffer a read's receive stamp fits in
+
+enum tstamp_stage {
+    TS_RX_READ,
+    TS_READ_SEND,
+    TS_SEND_TX,
+    TS_RX_TX,
+    TS_STAGES,
+};
+
+// stage histograms of one event loop, or of one fork-mode child; in ns
+struct tstamp_hists {
+    const char *name;
+    struct hist stage[TS_STAGES];
+    uint64_t unmatched;  // transmit stamps whose send() was no longer remembered
+    struct tstamp_hists *next;
+};
+
+// per-connection stamps; times are CLOCK_REALTIME ns, the kernel's stamp clock
+struct tstamp_conn {
+    uint64_t rx_kernel;  // receive stamp of the latest read, 0 before the first
+    uint64_t rx_user;    // when that read returned; 0 once its echo has been sent
+    uint32_t bytes;      // bytes handed to send() so far, the kernel's OPT_ID counter
+    unsigned head;       // oldest entry of pending[]
+    unsigned count;
+    struct {
+        uint32_t id;         // OPT_ID of the send's last byte
+        uint64_t rx_kernel;
+        uint64_t send_user;
+    } pending[TSTAMP_PENDING];
+};
+
+// a set of histograms, listed in the SIGUSR1 dump
+struct tstamp_hists *tstamp_hists_new(const char *name);
+
+// turn stamping on for a fresh TCP connection, before anything is sent on it;
+// returns -1 (with a warning the first time) if the kernel refuses
+int tstamp_enable(int fd);
+void tstamp_conn_init(struct tstamp_conn *tc);
+
+// after a read: take the receive stamp out of recvmsg()'s control data
+void tstamp_received(struct tstamp_conn *tc, const void *control, size_t controllen,
+                     struct tstamp_hists *h);
+
+// the stamp clock; read just before a send(), since on loopback the packet is
+// transmitted (and stamped) before send() returns
+uint64_t tstamp_now(void);
+
+// after send() took n bytes of an echo; `now` is tstamp_now() from before the call
+void tstamp_sent(struct tstamp_conn *tc, size_t n, uint64_t now, struct tstamp_hists *h);
+
+// collect transmit stamps from the socket's error queue without blocking
+void tstamp_reap(int fd, struct tstamp_conn *tc, struct tstamp_hists *h);
+
+#endif // TSTAMP_H
@@ -0,0 +1,161 @@
+// udp_server.c - UDP echo: every datagram goes back to its sender unchanged
+#define _GNU_SOURCE  // recvmmsg(), sendmmsg()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "server.h"
+#include "stats.h"
+#include "log.h"
+#include "affinity.h"
+
+#define UDP_DGRAM_MAX 65536  // largest datagram echoed in full
+
+// one socket and the thread that serves it
+struct udp_worker {
+    int id;
+    int fd;
+    const struct server_config *cfg;
+    pthread_t thread;
+    struct echo_stats stats;  // lines = datagrams, calls = recvmmsg()/sendmmsg()
+    char name[16];
+};
+
+// bind a UDP socket to cfg->port; with several workers each gets its own SO_REUSEPORT socket
+static int create_udp_socket(const struct server_config *cfg) {
+    struct sockaddr_in servaddr;
+    int on = 1;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("Server: Socket Creation Error");
+        exit(EXIT_FAILURE);
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+        perror("Server: Socket Option Setup Failed.");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg->threads > 1 && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        perror("Server: SO_REUSEPORT");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    servaddr.sin_port = htons(cfg->port);
+    if (bind(fd, (struct sockaddr *)&servaddr, sizeof(servaddr)) < 0) {
+        perror("Server: Bind Error");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// log a datagram like a received line, adding the newline it may lack
+static void log_datagram(const char *p, size_t len) {
+    if (log_sample()) {
+        int nl = len > 0 && p[len - 1] == '\n';
+        log_write(LOG_DEBUG, "Server Received: %.*s%s", (int)len, p, nl ? "" : "\n");
+    }
+}
+
+// receive up to cfg->batch datagrams per recvmmsg() and echo them with sendmmsg()
+static void udp_loop(struct udp_worker *w) {
+    int batch = w->cfg->batch;
+    struct mmsghdr *msgs = calloc(batch, sizeof(*msgs));
+    struct iovec *iov = calloc(batch, sizeof(*iov));
+    struct sockaddr_storage *addrs = calloc(batch, sizeof(*addrs));
+    char *bufs = malloc((size_t)batch * UDP_DGRAM_MAX);  // pages are touched only as datagrams land
+
+    if (msgs == NULL || iov == NULL || addrs == NULL || bufs == NULL) {
+        perror("Server: Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+
+    while (1) {
+        for (int i = 0; i < batch; i++) {
+            iov[i].iov_base = bufs + (size_t)i * UDP_DGRAM_MAX;
+            iov[i].iov_len = UDP_DGRAM_MAX;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // block for the first datagram, then take whatever else is already queued
+        int n = recvmmsg(w->fd, msgs, batch, MSG_WAITFORONE, NULL);
+        w->stats.recv_calls++;
+        if (stats_dump_requested()) {
+            stats_dump(stdout);
+        }
+        if (n < 0) {
+            if (errno != EINTR) {
+                perror("Server: recvmmsg");
+            }
+            continue;
+        }
+
+        for (int i = 0; i < n; i++) {
+            iov[i].iov_len = msgs[i].msg_len;  // reply with exactly what arrived
+            log_datagram(iov[i].iov_base, msgs[i].msg_len);
+            w->stats.lines++;
+            w->stats.bytes += msgs[i].msg_len;
+        }
+
+        for (int off = 0; off < n;) {
+            int m = sendmmsg(w->fd, msgs + off, n - off, 0);
+            w->stats.send_calls++;
+            if (m < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Server: sendmmsg");
+                off++;  // the failed datagram is dropped, the rest still go out
+                continue;
+            }
+            off += m;
+        }
+    }
+}
+
+static void *udp_thread(void *arg) {
+    struct udp_worker *w = arg;
+    placement_apply(w->id);
+    udp_loop(w);
+    return NULL;
+}
+
+// one SO_REUSEPORT socket per thread; the kernel spreads senders across them
+void run_udp_server(const struct server_config *cfg) {
+    int n = cfg->threads;
+    struct udp_worker *ws = calloc(n, sizeof(*ws));
+    if (ws == NULL) {
+        perror("Server: Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < n; i++) {
+        ws[i].id = i;
+        ws[i].cfg = cfg;
+        ws[i].fd = create_udp_socket(cfg);
+        snprintf(ws[i].name, sizeof(ws[i].name), "udp %d", i);
+        stats_register(&ws[i].stats, ws[i].name);
+    }
+    printf("Server: Listening on Port %d (udp mode, %d sockets, batch %d)\n", cfg->port, n,
+           cfg->batch);
+    log_start();
+
+    for (int i = 1; i < n; i++) {
+        if (pthread_create(&ws[i].thread, NULL, udp_thread, &ws[i]) != 0) {
+            perror("Server: pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    placement_apply(0);
+    udp_loop(&ws[0]);  // the main thread serves the first socket
+}
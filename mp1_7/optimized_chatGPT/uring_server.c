@@ -0,0 +1,598 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "server.h"
+#include "stats.h"
+#include "log.h"
+#include "wheel.h"
+#include "accept.h"
+#include "pool.h"
+
+#define RING_ENTRIES 1024  // submission queue size
+#define BUF_GROUP 0        // provided buffer group id used by every recv
+#define BUF_COUNT 1024     // buffers in the provided ring (power of two)
+#define BUF_SIZE 4096      // bytes per provided buffer
+#define MAX_CHAIN 16       // sends linked into one in-order chain
+#define ACCEPT_RETRY_MS 100  // wait before re-arming an accept that failed
+
+// operation tag kept in the low bits of user_data
+enum uring_op {
+    OP_ACCEPT = 1,
+    OP_RECV = 2,
+    OP_SEND = 3,
+    OP_TIMER = 4,  // wheel tick for --idle-timeout
+    OP_ACCEPT_RETRY = 5,  // re-arm a failed accept; the listener index rides above the op bits
+};
+#define OP_MASK 7UL
+
+// per-connection state; buffers queued for sending are chained through buf_next[]
+struct uconn {
+    int fd;
+    int refs;           // submitted operations not yet completed
+    int send_head;      // first queued buffer id, -1 if none
+    int send_tail;
+    int chain;          // sends of the current linked chain still in flight
+    int recv_armed;     // a recv is in flight
+    int paused;         // not receiving: queue passed the high watermark
+    size_t queued;      // received bytes not yet echoed
+    int eof;            // peer closed its side
+    int closing;        // shut down, freed when refs drops to 0
+    int line_start;     // next byte logged starts a new line
+    int line_logged;    // the line in progress was picked by log sampling
+    struct uconn *starved_next;  // waiting for provided buffers
+    int starved;
+    struct timer_node idle;      // idle timer, re-armed lazily from last_active
+    uint64_t last_active;        // ms of the last completion on this connection
+};
+
+// mmapped io_uring state, driven with raw syscalls (no liburing)
+struct uring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned to_submit;
+
+    struct io_uring_buf_ring *br;  // provided buffer ring
+    char *bufs;                     // BUF_COUNT * BUF_SIZE receive buffers
+    unsigned short br_tail;
+    int buf_next[BUF_COUNT];        // per-buffer send queue link
+    unsigned buf_off[BUF_COUNT];    // bytes of the buffer already sent
+    unsigned buf_len[BUF_COUNT];    // bytes received into the buffer
+
+    struct echo_stats stats;
+    struct uconn *starved;          // connections whose recv ran out of buffers
+    int recycled;                   // buffers returned since starved recvs were last retried
+    struct listeners ls;            // one multishot accept each; the index rides in user_data
+
+    const struct server_config *cfg;
+    struct timer_wheel idle;        // --idle-timeout: one entry per connection
+    struct slab_pool conns;         // struct uconn
+    uint64_t now_ms;                // wheel clock, read after every wait
+    struct __kernel_timespec tick;  // IORING_OP_TIMEOUT period
+    struct __kernel_timespec retry; // ACCEPT_RETRY_MS
+    uint64_t accept_err_ms;         // last accept error printed
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// create the ring and map its submission/completion queues
+static void uring_init(struct uring *u) {
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    u->fd = sys_io_uring_setup(RING_ENTRIES, &p);
+    if (u->fd < 0) {
+        perror("Server: io_uring_setup");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+    }
+
+    char *sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    u->fd, IORING_OFF_SQ_RING);
+    char *cq = sq;
+    if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  u->fd, IORING_OFF_CQ_RING);
+    }
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || u->sqes == MAP_FAILED) {
+        perror("Server: io_uring mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+}
+
+// hand a receive buffer (back) to the kernel
+static void buf_recycle(struct uring *u, int bid) {
+    struct io_uring_buf *b = &u->br->bufs[u->br_tail & (BUF_COUNT - 1)];
+
+    b->addr = (uintptr_t)(u->bufs + (size_t)bid * BUF_SIZE);
+    b->len = BUF_SIZE;
+    b->bid = bid;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+    u->recycled = 1;
+}
+
+// register the provided buffer ring that recv picks buffers from
+static void uring_setup_buffers(struct uring *u) {
+    struct io_uring_buf_reg reg;
+
+    u->br = mmap(NULL, BUF_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->bufs = mmap(NULL, (size_t)BUF_COUNT * BUF_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->br == MAP_FAILED || u->bufs == MAP_FAILED) {
+        perror("Server: Buffer Ring mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)u->br;
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (sys_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("Server: IORING_REGISTER_PBUF_RING (needs Linux 5.19+)");
+        exit(EXIT_FAILURE);
+    }
+
+    u->br_tail = 0;
+    for (int i = 0; i < BUF_COUNT; i++) {
+        buf_recycle(u, i);
+    }
+}
+
+// submit queued SQEs, optionally waiting for at least one completion; returns how
+// many were submitted
+static int uring_submit(struct uring *u, unsigned wait) {
+    while (1) {
+        int rc = sys_io_uring_enter(u->fd, u->to_submit, wait,
+                                    wait ? IORING_ENTER_GETEVENTS : 0);
+        if (rc >= 0) {
+            u->to_submit -= rc;
+            return rc;
+        }
+        if (errno == EINTR) {
+            if (wait) {
+                return 0;  // a signal (SIGUSR1) - let the loop see it before sleeping again
+            }
+            continue;
+        }
+        if (errno == EBUSY || errno == EAGAIN) {
+            return 0;  // completion queue backed up - reap first
+        }
+        perror("Server: io_uring_enter");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// submit, then wait for completions; --low-latency watches the shared completion
+// queue from user space for up to --spin microseconds before sleeping in the kernel
+static void uring_wait(struct uring *u) {
+    if (u->cfg->low_latency && u->cfg->spin_us > 0) {
+        uring_submit(u, 0);
+        uint64_t deadline = now_ns() + u->cfg->spin_us * 1000ULL;
+        do {
+            if (__atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) != *u->cq_head) {
+                u->stats.spin_hits++;
+                return;
+            }
+        } while (now_ns() < deadline);
+        u->stats.spin_sleeps++;
+    }
+    uring_submit(u, 1);
+}
+
+// grab a zeroed SQE, flushing the submission queue if it is full. That happens while
+// completions are being handled; the loop has already released every CQE up to the
+// one in hand, so completions the kernel is holding back can be moved into the freed
+// slots, after which it takes submissions again
+static struct io_uring_sqe *uring_sqe(struct uring *u) {
+    unsigned tail = *u->sq_tail;
+
+    while (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= RING_ENTRIES) {
+        if (uring_submit(u, 0) == 0) {
+            sys_io_uring_enter(u->fd, 0, 0, IORING_ENTER_GETEVENTS);  // flush the CQ overflow
+        }
+    }
+
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+    return sqe;
+}
+
+// multishot accept: one SQE keeps producing a CQE per new connection
+static void arm_accept(struct uring *u, int i) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = u->ls.fd[i];
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = ((uint64_t)i << 3) | OP_ACCEPT;  // listener index above the op bits
+}
+
+// wake up once per wheel tick even when no I/O completes
+static void arm_timer(struct uring *u) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+
+    u->tick.tv_sec = 0;
+    u->tick.tv_nsec = WHEEL_TICK_MS * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uintptr_t)&u->tick;
+    sqe->len = 1;
+    sqe->user_data = OP_TIMER;
+}
+
+// re-arm listener i's accept after ACCEPT_RETRY_MS rather than at once
+static void arm_accept_retry(struct uring *u, int i) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+
+    u->retry.tv_sec = 0;
+    u->retry.tv_nsec = ACCEPT_RETRY_MS * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uintptr_t)&u->retry;
+    sqe->len = 1;
+    sqe->user_data = ((uint64_t)i << 3) | OP_ACCEPT_RETRY;
+}
+
+// one recv into a buffer picked from the provided ring. Not multishot: that drains the
+// whole socket backlog into the shared ring before a completion can be looked at, so
+// --high-water could not stop a client that never reads
+static void arm_recv(struct uring *u, struct uconn *c) {
+    struct io_uring_sqe *sqe = uring_sqe(u);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = (uintptr_t)c | OP_RECV;
+    c->recv_armed = 1;
+    c->refs++;
+}
+
+// submit queued buffers as one IOSQE_IO_LINK chain so they go out in order
+static void submit_sends(struct uring *u, struct uconn *c) {
+    int bid = c->send_head;
+
+    while (bid >= 0 && c->chain < MAX_CHAIN) {
+        struct io_uring_sqe *sqe = uring_sqe(u);
+
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = c->fd;
+        sqe->addr = (uintptr_t)(u->bufs + (size_t)bid * BUF_SIZE + u->buf_off[bid]);
+        sqe->len = u->buf_len[bid] - u->buf_off[bid];
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;  // retry short sends in the kernel
+        sqe->user_data = (uintptr_t)c | OP_SEND;
+        u->stats.send_calls++;
+        c->chain++;
+        c->refs++;
+
+        bid = u->buf_next[bid];
+        if (bid >= 0 && c->chain < MAX_CHAIN) {
+            sqe->flags = IOSQE_IO_LINK;  // next send starts only after this one completes
+        }
+    }
+}
+
+// stop serving a connection; it is freed once its last operation completes
+static void uconn_close(struct uring *u, struct uconn *c) {
+    if (!c->closing) {
+        c->closing = 1;
+        wheel_del(&u->idle, &c->idle);
+        shutdown(c->fd, SHUT_RDWR);  // makes pending recv/send complete promptly
+    }
+    if (c->refs > 0 || c->starved) {
+        return;
+    }
+    for (int bid = c->send_head; bid >= 0; ) {
+        int next = u->buf_next[bid];
+        buf_recycle(u, bid);
+        bid = next;
+    }
+    close(c->fd);
+    slab_free(&u->conns, c);
+}
+
+// retry recv on connections that ran out of provided buffers
+static void rearm_starved(struct uring *u) {
+    u->recycled = 0;
+    while (u->starved != NULL) {
+        struct uconn *c = u->starved;
+        u->starved = c->starved_next;
+        c->starved = 0;
+        if (c->closing) {
+            uconn_close(u, c);
+        } else if (!c->paused) {
+            arm_recv(u, c);
+        }
+    }
+}
+
+static void on_accept(struct uring *u, struct io_uring_cqe *cqe) {
+    int i = (int)(cqe->user_data >> 3);
+
+    if (cqe->res < 0) {
+        int err = -cqe->res;
+        if (err == EMFILE || err == ENFILE) {
+            // the kernel fails before it looks at the queue, so this says nothing about
+            // waiting connections: drop what is queued, as the epoll modes do
+            while (accept_shed(u->ls.fd[i])) {
+            }
+        } else if (err != ECONNABORTED && u->now_ms - u->accept_err_ms >= 1000) {
+            u->accept_err_ms = u->now_ms;  // at most one message a second
+            errno = err;
+            perror("Server: Accept Failed.");
+        }
+        // a failure ends the multishot accept: come back to it later, not in a tight loop
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            arm_accept_retry(u, i);
+        }
+        return;
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        arm_accept(u, i);  // multishot accept stopped - arm it again
+    }
+
+    struct uconn *c = slab_alloc(&u->conns);
+    if (c == NULL) {
+        perror("Server: Out of Memory");
+        close(cqe->res);
+        return;
+    }
+    memset(c, 0, sizeof(*c));
+    c->fd = cqe->res;
+    tune_connection(c->fd, u->cfg);  // TCP_QUICKACK only holds until it lapses - no per-recv syscall here
+    c->send_head = c->send_tail = -1;
+    c->line_start = 1;
+    if (u->cfg->idle_timeout > 0) {
+        c->last_active = u->now_ms;
+        wheel_add(&u->idle, &c->idle, u->now_ms + u->cfg->idle_timeout * 1000ULL);
+    }
+    arm_recv(u, c);
+}
+
+static void on_recv(struct uring *u, struct uconn *c, struct io_uring_cqe *cqe) {
+    c->recv_armed = 0;
+    c->refs--;
+
+    u->stats.recv_calls++;
+    c->last_active = u->now_ms;
+    if (cqe->res > 0) {
+        int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+        if (c->closing) {
+            buf_recycle(u, bid);
+        } else {
+            log_stream(u->bufs + (size_t)bid * BUF_SIZE, cqe->res, &c->line_start, &c->line_logged,
+                       &u->stats);
+
+            // queue the buffer itself for sending - the echo needs no copy
+            u->buf_off[bid] = 0;
+            u->buf_len[bid] = cqe->res;
+            u->buf_next[bid] = -1;
+            if (c->send_tail >= 0) {
+                u->buf_next[c->send_tail] = bid;
+            } else {
+                c->send_head = bid;
+            }
+            c->send_tail = bid;
+            c->queued += cqe->res;
+            if (c->queued > u->stats.queue_peak) {
+                u->stats.queue_peak = c->queued;
+            }
+            if (c->chain == 0) {
+                submit_sends(u, c);
+            }
+            // a client that sends faster than it reads must not take the whole shared
+            // buffer ring: stop receiving from it until on_send() drains its queue
+            if (c->queued >= u->cfg->high_water && !c->paused) {
+                c->paused = 1;
+                u->stats.pauses++;
+            }
+        }
+        if (!c->closing && !c->paused) {
+            arm_recv(u, c);
+        }
+    } else if (cqe->res == -ENOBUFS) {
+        if (!c->starved && !c->closing && !c->paused) {  // wait until sends return buffers to the ring
+            c->starved = 1;
+            c->starved_next = u->starved;
+            u->starved = c;
+        }
+    } else {
+        if (cqe->res < 0 && cqe->res != -ECONNRESET && !c->closing) {
+            errno = -cqe->res;
+            perror("Server: Read Error");
+        }
+        c->eof = 1;  // EOF or error - finish sending, then close
+        if (cqe->res < 0 || c->send_head < 0) {
+            uconn_close(u, c);
+            return;
+        }
+    }
+
+    if (c->closing) {
+        uconn_close(u, c);
+    }
+}
+
+static void on_send(struct uring *u, struct uconn *c, struct io_uring_cqe *cqe) {
+    int bid = c->send_head;
+
+    c->refs--;
+    c->chain--;
+    c->last_active = u->now_ms;
+
+    if (cqe->res >= 0 && bid >= 0 && !c->closing) {
+        u->buf_off[bid] += cqe->res;
+        c->queued -= cqe->res;
+        if (u->buf_off[bid] >= u->buf_len[bid]) {  // buffer fully sent - give it back
+            c->send_head = u->buf_next[bid];
+            if (c->send_head < 0) {
+                c->send_tail = -1;
+            }
+            buf_recycle(u, bid);
+        }
+    } else if (cqe->res != -ECANCELED && !c->closing) {
+        // a short send breaks the link and cancels the rest, which is resubmitted below
+        errno = -cqe->res;
+        perror("Server: Error while sending.");
+        uconn_close(u, c);
+        return;
+    }
+
+    if (c->closing) {
+        uconn_close(u, c);
+        return;
+    }
+    if (c->paused && c->queued <= u->cfg->low_water) {
+        c->paused = 0;  // drained below the low watermark - receive again
+        if (!c->recv_armed && !c->starved && !c->eof) {
+            arm_recv(u, c);
+        }
+    }
+    if (c->chain == 0) {
+        if (c->send_head >= 0) {
+            submit_sends(u, c);
+        } else if (c->eof) {
+            uconn_close(u, c);
+        }
+    }
+}
+
+// idle timer fired: shut the connection down, or re-arm if it has been active since
+static void idle_expired(struct timer_node *t, void *arg) {
+    struct uring *u = arg;
+    struct uconn *c = (struct uconn *)((char *)t - offsetof(struct uconn, idle));
+    uint64_t deadline = c->last_active + u->cfg->idle_timeout * 1000ULL;
+
+    if (deadline > u->now_ms) {
+        wheel_add(&u->idle, &c->idle, deadline);
+        return;
+    }
+    log_write(LOG_INFO, "Server: Closing Connection Idle for %d s\n", u->cfg->idle_timeout);
+    u->stats.idle_closed++;
+    uconn_close(u, c);
+}
+
+// serve every connection from one thread through a single io_uring
+void run_uring_server(const struct listeners *ls, const struct server_config *cfg) {
+    struct uring *u = calloc(1, sizeof(*u));
+
+    if (u == NULL) {
+        perror("Server: Out of Memory");
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    u->ls = *ls;
+    u->cfg = cfg;
+    u->now_ms = wheel_now_ms();
+    wheel_init(&u->idle, u->now_ms, WHEEL_TICK_MS);
+    stats_register(&u->stats, "uring");
+    slab_init(&u->conns, "uring", "conn", sizeof(struct uconn));
+    uring_init(u);
+    uring_setup_buffers(u);
+    for (int i = 0; i < ls->n; i++) {
+        arm_accept(u, i);
+    }
+    if (cfg->idle_timeout > 0) {
+        arm_timer(u);
+    }
+
+    while (1) {
+        uring_wait(u);
+        u->now_ms = wheel_now_ms();
+        if (stats_dump_requested()) {
+            stats_dump(stdout);
+        }
+
+        unsigned head = *u->cq_head;
+        int accepts = 0;
+        unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            // take the entry and release its slot before handling it: a handler that finds
+            // the submission queue full needs room in the completion queue to get going
+            struct io_uring_cqe entry = u->cqes[head & *u->cq_mask];
+            struct io_uring_cqe *cqe = &entry;
+            struct uconn *c = (struct uconn *)(uintptr_t)(cqe->user_data & ~OP_MASK);
+
+            __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+
+            switch (cqe->user_data & OP_MASK) {
+            case OP_ACCEPT:
+                accepts += cqe->res >= 0;
+                on_accept(u, cqe);
+                break;
+            case OP_RECV:
+                on_recv(u, c, cqe);
+                break;
+            case OP_SEND:
+                on_send(u, c, cqe);
+                break;
+            case OP_TIMER:
+                arm_timer(u);
+                break;
+            case OP_ACCEPT_RETRY:
+                arm_accept(u, (int)(cqe->user_data >> 3));
+                break;
+            }
+        }
+        if (accepts > 0) {
+            accept_count(accepts);  // the kernel's multishot accept batches for us
+        }
+        wheel_advance(&u->idle, u->now_ms, idle_expired, u);
+
+        if (u->starved != NULL && u->recycled) {
+            rearm_starved(u);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#include <time.h>
+
+#include "wheel.h"
+
+uint64_t wheel_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);  // vDSO, no syscall; a few ms resolution is plenty
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void wheel_init(struct timer_wheel *w, uint64_t now_ms, uint64_t tick_ms) {
+    for (int i = 0; i < WHEEL_SLOTS; i++) {
+        w->slots[i].next = w->slots[i].prev = &w->slots[i];
+    }
+    w->tick_ms = tick_ms;
+    w->tick = now_ms / tick_ms;
+    w->count = 0;
+}
+
+static void unlink_node(struct timer_node *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+void wheel_add(struct timer_wheel *w, struct timer_node *t, uint64_t expire_ms) {
+    uint64_t expire = (expire_ms + w->tick_ms - 1) / w->tick_ms;
+
+    if (t->next != NULL) {
+        wheel_del(w, t);
+    }
+    if (expire <= w->tick) {
+        expire = w->tick + 1;  // already due - fire on the next tick
+    }
+    t->expire = expire;
+
+    struct timer_node *head = &w->slots[expire & (WHEEL_SLOTS - 1)];
+    t->next = head->next;
+    t->prev = head;
+    head->next->prev = t;
+    head->next = t;
+    w->count++;
+}
+
+void wheel_del(struct timer_wheel *w, struct timer_node *t) {
+    if (t->next != NULL) {
+        unlink_node(t);
+        w->count--;
+    }
+}
+
+void wheel_advance(struct timer_wheel *w, uint64_t now_ms,
+                   void (*expired)(struct timer_node *t, void *arg), void *arg) {
+    uint64_t target = now_ms / w->tick_ms;
+
+    if (target - w->tick > WHEEL_SLOTS && target > w->tick) {
+        w->tick = target - WHEEL_SLOTS;  // long stall: one revolution visits every bucket
+    }
+    while (w->tick < target) {
+        w->tick++;
+        struct timer_node *head = &w->slots[w->tick & (WHEEL_SLOTS - 1)];
+
+        // entries re-armed by the callback go in at the head, behind the cursor
+        for (struct timer_node *t = head->next, *next; t != head; t = next) {
+            next = t->next;
+            if (t->expire <= w->tick) {
+                unlink_node(t);
+                w->count--;
+                expired(t, arg);
+            }
+        }
+    }
+}
+
+int wheel_timeout_ms(const struct timer_wheel *w, uint64_t now_ms) {
+    if (w->count == 0) {
+        return -1;
+    }
+    uint64_t next = (w->tick + 1) * w->tick_ms;
+    return next > now_ms ? (int)(next - now_ms) : 0;
+}
@@ -0,0 +1,45 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WHEEL_SLOTS 512  // buckets per revolution (power of two)
+#define WHEEL_TICK_MS 100  // tick of the servers' idle-timeout wheels
+
+// intrusive timer entry; embed one in the object being timed
+struct timer_node {
+    struct timer_node *next;  // NULL while not armed
+    struct timer_node *prev;
+    uint64_t expire;          // tick the entry is due in
+};
+
+// hashed timing wheel: add, delete and expiry are O(1), entries further out than one
+// revolution wait in their bucket until their tick comes round
+struct timer_wheel {
+    struct timer_node slots[WHEEL_SLOTS];  // circular list heads
+    uint64_t tick;                         // last tick processed
+    uint64_t tick_ms;                      // resolution; one revolution is WHEEL_SLOTS ticks
+    size_t count;                          // armed entries
+};
+
+// milliseconds on a cheap monotonic clock
+uint64_t wheel_now_ms(void);
+
+void wheel_init(struct timer_wheel *w, uint64_t now_ms, uint64_t tick_ms);
+
+// arm t to fire at or shortly after expire_ms (rounded up to the next tick)
+void wheel_add(struct timer_wheel *w, struct timer_node *t, uint64_t expire_ms);
+
+// disarm t; harmless if it is not armed
+void wheel_del(struct timer_wheel *w, struct timer_node *t);
+
+// process every tick up to now_ms, calling expired() on each due entry after unlinking it;
+// the callback may re-arm the entry or free the object around it
+void wheel_advance(struct timer_wheel *w, uint64_t now_ms,
+                   void (*expired)(struct timer_node *t, void *arg), void *arg);
+
+// milliseconds until the next tick, or -1 if nothing is armed (epoll_wait() timeout)
+int wheel_timeout_ms(const struct timer_wheel *w, uint64_t now_ms);
+
+#endif // WHEEL_H